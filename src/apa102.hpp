@@ -1,7 +1,9 @@
 /**
  * \file apa102.hpp
  *
- * Simple APA102 driver using Linux userspace SPI support.
+ * APA102 LED frame format.
+ *
+ * \sa led_strip.hpp for the driver.
  *
  * \copyright Shenghao Yang, 2018
  *
@@ -13,15 +15,7 @@
 
 #include <array>
 #include <cstdint>
-#include <cstring>
-#include <fcntl.h>
-#include <linux/spi/spidev.h>
-#include <linux/types.h>
-#include <sys/ioctl.h>
-#include <system_error>
 #include <type_traits>
-#include <unistd.h>
-#include <vector>
 
 namespace apa102
 {
@@ -61,9 +55,10 @@ struct output {
    * Additional note - I'd like for this header to be a private field,
    * but that does not guarantee a standard structure layout, i.e.
    * the header may not be the first field in the structure.
-   * Having all members public ensures that the structure will be packed
-   * in the obvious order. If that's the case the we can simply memcpy() to
-   * our heart's content.
+   *
+   * The order of bit-fields within a byte is up to the ABI, and GCC places
+   * the header in the low bits on little-endian targets. The structure must
+   * therefore not be copied to the wire as-is - use encode() instead.
    */
   ::std::uint8_t hdr : 3;
   ::std::uint8_t brt : 5; ///< LED brightness
@@ -133,138 +128,30 @@ make_output(std::uint8_t brt, std::uint8_t red, std::uint8_t green,
 }
 
 /**
- * Class used to control APA102 LEDs connected to device I/O lines.
+ * Encodes an output structure into the 4-byte LED command sent on the wire:
+ * three header bits of ones above the 5-bit brightness, followed by the
+ * blue, green and red channels.
+ *
+ * \param o output structure.
+ * \return LED command bytes, in transmission order.
  */
-class apa102
+constexpr std::array<std::uint8_t, 4>
+encode(const output& o) noexcept
 {
-private:
-  using framebuffer_type = std::vector<std::uint8_t>;
-
-  int fd;
-  std::size_t num_leds;
-  framebuffer_type framebuffer;
-  std::uint8_t* pixel_data_start{nullptr};
-  spi_ioc_transfer xfer{};
-
-public:
-  /**
-   * Construct a new object representing a string of APA102 LEDs.
-   *
-   * \param path path to userspace SPI device.
-   * \param period clock waveform period, in nanoseconds
-   * \param reset whether to reset all LEDs to blank output
-   * \throws std::system_error on failure in process of acquiring control of
-   * SPI device, or failure in resetting LEDs to blank.
-   */
-  apa102(const std::string& path, std::uint32_t period, std::size_t leds,
-         bool reset = false)
-      : fd{open(path.c_str(), O_RDWR)}, num_leds{leds}, framebuffer{}
-  {
-    framebuffer.resize(end_bytes_required(leds) + start_sequence.size() +
-                           (sizeof(output) * leds),
-                       0);
-    pixel_data_start = {framebuffer.data() + start_sequence.size()};
-
-    std::uint32_t spi_mode{SPI_MODE_0};
-    std::uint8_t spi_lsbfirst{0};
-    if ((fd == -1) || (ioctl(fd, SPI_IOC_WR_MODE32, &spi_mode) == -1) ||
-        (ioctl(fd, SPI_IOC_WR_LSB_FIRST, &spi_lsbfirst) == -1))
-      throw std::system_error{errno, std::system_category()};
-
-    fill(make_output(0, 0, 0, 0));
-
-    std::memset(reinterpret_cast<void*>(&xfer), 0, sizeof(xfer));
-    xfer.tx_buf        = reinterpret_cast<__u64>(framebuffer.data());
-    xfer.rx_buf        = reinterpret_cast<__u64>(nullptr);
-    xfer.len           = framebuffer.size();
-    xfer.speed_hz      = (UINT32_C(1000000000) / period);
-    xfer.delay_usecs   = 0;
-    xfer.bits_per_word = 8;
-    xfer.cs_change     = 0;
-
-    if (reset) commit();
-  }
-
-  apa102(const output& other)  = delete;
-  apa102(const output&& other) = delete;
-  apa102&
-  operator=(const output& other) = delete;
-  apa102&
-  operator=(const output&& other) = delete;
-
-  /**
-   * Get the output setting of a particular LED.
-   *
-   * \param led index of the LED to access. Must be within
-   * the range \c 0 to the number of LEDs in the string - 1
-   * \return output structure representing the output setting of that
-   * particular LED.
-   */
-  output operator[](std::size_t led) const
-  {
-    auto temp = make_output(0, 0, 0, 0);
-    std::copy(pixel_data_start + (led * sizeof(temp)),
-              pixel_data_start + ((led + 1) * sizeof(temp)),
-              reinterpret_cast<std::uint8_t* const>(&temp));
-    return temp;
-  }
-
-  /**
-   * Set the output setting of a particular LED.
-   *
-   * \param led index of the LED to set the output setting for.
-   * \param v desired output setting.
-   */
-  void
-  set(std::size_t led, const output& v)
-  {
-    std::copy(reinterpret_cast<const std::uint8_t* const>(&v),
-              reinterpret_cast<const std::uint8_t* const>(&v) + sizeof(v),
-              pixel_data_start + (led * sizeof(v)));
-  }
-
-  /**
-   * See \ref ::std::array::fill()
-   */
-  void
-  fill(const output& v)
-  {
-    for (std::size_t i{0}; i < num_leds; i++) set(i, v);
-  }
-
-  /**
-   * Commit changes to the framebuffer to the actual LEDs.
-   *
-   * \throws ::std::system_error on error while writing to the LEDs
-   */
-  void
-  commit()
-  {
-    if (ioctl(fd, SPI_IOC_MESSAGE(1), &xfer) == -1)
-      throw std::system_error{errno, std::system_category()};
-  }
-
-  /**
-   * Obtain the number of LEDs controlled by this object.
-   *
-   * \return LED count.
-   */
-  std::size_t
-  size() const
-  {
-    return num_leds;
-  }
+  return {static_cast<std::uint8_t>(0xe0 | (o.brt & 0x1f)), o.blue, o.green,
+          o.red};
+}
 
-  /**
-   * Destructor for the apa102 object.
-   *
-   * Closes the file descriptor used to access the userspace SPI device.
-   */
-  ~apa102()
-  {
-    if (fd != -1) close(fd);
-  }
-};
+static_assert(
+    []() {
+      for (unsigned int brt{0}; brt <= 0x1f; brt++) {
+        auto frame{encode(make_output(brt, 0, 0, 0))};
+        if (((frame[0] & 0xe0) != 0xe0) || ((frame[0] & 0x1f) != brt))
+          return false;
+      }
+      return true;
+    }(),
+    "LED command header bits are not all ones at every brightness");
 } // namespace apa102
 
 #endif /* APA102_HPP_ */
@@ -0,0 +1,101 @@
+/**
+ * \file ddp_receiver.cpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <ddp_receiver.hpp>
+
+namespace ddp_receiver
+{
+
+void
+receiver::process_packet(std::size_t len)
+{
+  /* Header layout, DDP specification v1 */
+  constexpr std::size_t header_size{10};
+  constexpr std::size_t timecode_size{4};
+  constexpr std::uint8_t version_mask{0xc0};
+  constexpr std::uint8_t version_1{0x40};
+  constexpr std::uint8_t flag_timecode{0x10};
+  constexpr std::uint8_t flag_query{0x02};
+  constexpr std::uint8_t flag_push{0x01};
+
+  if (len < header_size) return;
+
+  std::uint8_t flags{buffer[0]};
+  std::size_t offset((std::size_t{buffer[4]} << 24) | (buffer[5] << 16) |
+                     (buffer[6] << 8) | buffer[7]);
+  std::size_t length((buffer[8] << 8) | buffer[9]);
+  std::size_t data_start{header_size +
+                         ((flags & flag_timecode) ? timecode_size : 0)};
+
+  if (((flags & version_mask) != version_1) || (flags & flag_query) ||
+      (buffer[3] != default_output_id) || (len < data_start) ||
+      (length > (len - data_start)))
+    return;
+
+  /*
+   * Senders that never set the push flag expect every packet to be
+   * displayed immediately.
+   */
+  push_seen = push_seen || (flags & flag_push);
+  sink(offset, buffer.data() + data_start, length,
+       (flags & flag_push) || !push_seen);
+}
+
+int
+receiver::socket_callback(sd_event_source* s, int fd, std::uint32_t revents,
+                          void* userdata) noexcept
+{
+  auto& rx{*reinterpret_cast<receiver*>(userdata)};
+
+  try {
+    if (revents & EPOLLERR) throw std::runtime_error{"error on DDP socket"};
+    do {
+      ::ssize_t r{::recv(fd, rx.buffer.data(), rx.buffer.size(),
+                         MSG_TRUNC)};
+      if (r == -1) {
+        if ((errno != EWOULDBLOCK) && (errno != EAGAIN))
+          throw std::system_error{errno, std::system_category()};
+        break;
+      }
+      /* Oversized packets are truncated, and skipped */
+      if (static_cast<std::size_t>(r) <= rx.buffer.size())
+        rx.process_packet(r);
+    } while (true);
+  } catch (const std::exception& e) {
+    sd_journal_print(LOG_CRIT, "Exception processing data from DDP socket: %s",
+                     e.what());
+    sd_event_exit(sd_event_source_get_event(s), EXIT_FAILURE);
+    return -1;
+  }
+
+  return 0;
+}
+
+receiver::receiver(sd_event* ev, sink_type data_sink)
+    : sink{std::move(data_sink)},
+      ddp_socket{socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)}
+{
+  int r;
+  sockaddr_in addr{};
+  sd_event_source* s;
+
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htobe16(ddp_port);
+  addr.sin_addr.s_addr = htobe32(INADDR_ANY);
+
+  if ((ddp_socket == -1) ||
+      (bind(ddp_socket, reinterpret_cast<const sockaddr*>(&addr),
+            sizeof(addr)) == -1))
+    throw std::system_error{errno, std::system_category()};
+
+  if ((r = sd_event_add_io(ev, &s, ddp_socket, EPOLLIN | EPOLLERR,
+                           socket_callback, this)) < 0)
+    throw std::system_error{-r, std::system_category()};
+  evs.reset(s);
+}
+} // namespace ddp_receiver
@@ -0,0 +1,108 @@
+/**
+ * \file ddp_receiver.hpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#ifndef DDP_RECEIVER_HPP_
+#define DDP_RECEIVER_HPP_
+
+#include <array>
+#include <cstdint>
+#include <deleters.hpp>
+#include <e131_receiver.hpp>
+#include <functional>
+#include <memory>
+#include <systemd/sd-event.h>
+
+/**
+ * Receiver for pixel data sent with the Distributed Display Protocol (DDP).
+ */
+namespace ddp_receiver
+{
+/**
+ * UDP port on which DDP packets are received.
+ */
+constexpr std::uint16_t ddp_port{4048};
+
+/**
+ * DDP destination ID of the default output device.
+ */
+constexpr std::uint8_t default_output_id{0x01};
+
+/**
+ * Receives DDP packets on an existing event loop, and hands the pixel data
+ * they carry to a sink without copying it.
+ *
+ * DDP addresses the output device as a flat array of bytes, three per
+ * RGB pixel, and is not limited to the 512 channels of a DMX universe.
+ */
+class receiver
+{
+public:
+  /**
+   * Sink for received pixel data.
+   *
+   * Called with the byte offset of the data into the output device, the data
+   * itself, its length, and whether the output device should be updated
+   * with the data received so far.
+   */
+  using sink_type = std::function<void(std::size_t offset,
+                                       const std::uint8_t* data,
+                                       std::size_t length, bool push)>;
+
+private:
+  /**
+   * Largest DDP packet accepted: a 14-byte header and 1480 bytes of data.
+   */
+  using buffer_type = std::array<std::uint8_t, 1494>;
+
+  sink_type sink;                      ///< Received pixel data sink
+  bool push_seen{false};               ///< Sender uses the push flag
+  buffer_type buffer{};                ///< Receive buffer
+  e131_receiver::unique_fd ddp_socket; ///< DDP socket fd
+  std::unique_ptr<sd_event_source, deleters::sd_event_source>
+      evs; ///< Socket I/O event source
+
+  /**
+   * Process a single received DDP packet.
+   *
+   * \param len number of bytes received into the receive buffer.
+   */
+  void
+  process_packet(std::size_t len);
+
+  /**
+   * Callback to be called by the event loop when data has been received
+   * on the DDP socket.
+   *
+   * \see sd_event_add_io for more information regarding
+   *      function arguments.
+   * \retval 0 callback execution success.
+   * \retval nonzero callback execution failure.
+   */
+  static int
+  socket_callback(sd_event_source* s, int fd, std::uint32_t revents,
+                  void* userdata) noexcept;
+
+public:
+  /**
+   * Start receiving DDP packets.
+   *
+   * \param ev event loop to receive packets on.
+   * \param data_sink sink for received pixel data.
+   * \throws std::system_error on system failures.
+   */
+  receiver(sd_event* ev, sink_type data_sink);
+  receiver(const receiver& other)  = delete;
+  receiver(const receiver&& other) = delete;
+  receiver&
+  operator=(const receiver& other) = delete;
+  receiver&
+  operator=(const receiver&& other) = delete;
+};
+} // namespace ddp_receiver
+
+#endif /* DDP_RECEIVER_HPP_ */
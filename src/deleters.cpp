@@ -9,6 +9,7 @@
  * See LICENSE for details
  */
 #include <deleters.hpp>
+#include <unistd.h>
 
 namespace deleters
 {
@@ -25,4 +26,10 @@ sd_event_source::operator()(::sd_event_source* evs)
   sd_event_source_unref(evs);
 }
 
+void
+file_path::operator()(const char* path)
+{
+  unlink(path);
+}
+
 } // namespace deleters
@@ -13,10 +13,12 @@
 #ifndef DELETERS_HPP_
 #define DELETERS_HPP_
 
+#include <sys/mman.h>
 #include <systemd/sd-event.h>
 
 /**
- * Deleters for \code sd-event loop objects.
+ * Deleters for \code sd-event loop objects, and for other resources held
+ * through pointers.
  *
  * Meant for use with \ref std::unique_ptr and \ref std::shared_ptr
  */
@@ -39,6 +41,28 @@ struct sd_event_source {
   operator()(::sd_event_source* evs);
 };
 
+/**
+ * Deleter for a memory mapping holding a single object, pointed to by a
+ * \code T*, unmapping it.
+ */
+template<typename T>
+struct mapping {
+  void
+  operator()(T* obj)
+  {
+    munmap(obj, sizeof(T));
+  }
+};
+
+/**
+ * Deleter for a file pointed to by its path, a \code const char*, removing
+ * the file.
+ */
+struct file_path {
+  void
+  operator()(const char* path);
+};
+
 } // namespace deleters
 
 #endif /* DELETERS_HPP_ */
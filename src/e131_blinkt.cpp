@@ -12,14 +12,27 @@ static const char* cmd_help{
 
 Usage:
     e131_blinkt [--help] [--verbose] [--spidev=FILE] [--config=FILE]
+                [--record=FILE | --play=FILE | --monitor]
     
 Options:
     --help          display this help message
     --verbose       enable verbose output for debugging
     --spidev=FILE   path to SPI device to use [default: /dev/spidev0.0]
     --config=FILE   config file  [default: /etc/e131_blinkt/e131_blinkt.conf]
+    --record=FILE   record the DMX data received into a show file
+    --play=FILE     play a show file back instead of receiving DMX data
+    --monitor       track every universe instead of driving the LEDs
 )"};
 
+using loop_watchdog::monotonic_usec;
+
+/**
+ * Interval at which the source statistics in the status reported to the
+ * service manager are refreshed while DMX data is received, in
+ * microseconds.
+ */
+constexpr std::uint64_t status_interval{5000000};
+
 static int
 sigterm_handler(sd_event_source* s, const struct signalfd_siginfo* si,
                 void* userdata)
@@ -30,17 +43,474 @@ sigterm_handler(sd_event_source* s, const struct signalfd_siginfo* si,
 }
 
 static int
-universe_handler(sd_event_source* s, int fd, uint32_t revents, void* userdata)
+sigusr1_handler(sd_event_source* s, const struct signalfd_siginfo* si,
+                void* userdata)
+{
+  auto& info{*reinterpret_cast<e131_blinkt::handler_info* const>(userdata)};
+  /* Taken before the statistics below allocate memory themselves */
+  auto allocations{heap_counter::allocations() - info.ready_allocations};
+  auto faults{e131_blinkt::minor_faults() - info.ready_faults};
+
+  try {
+    const auto& stats{info.uni.source_stats()};
+    if (stats.empty()) sd_journal_print(LOG_INFO, "No sources tracked.");
+    for (const auto& [uuid, source_stats] : stats) {
+      std::stringstream ss{};
+      ss << source_stats;
+      sd_journal_print(LOG_INFO, "Source %s: %s",
+                       e131_receiver::cid_str(uuid).c_str(), ss.str().c_str());
+    }
+    for (const auto& [uuid, announced] : info.uni.discovered_sources())
+      sd_journal_print(LOG_INFO, "Source %s announces this universe.",
+                       e131_receiver::cid_str(uuid).c_str());
+    /* Nonzero in the low-latency mode when memory is allocated after all */
+    sd_journal_print(LOG_INFO,
+                     "%ld page faults, %lu heap allocation(s) since ready.",
+                     faults, allocations);
+    info.watchdog->log_histogram();
+    if (info.idle) {
+      std::uint64_t iteration;
+      sd_event_get_iteration(sd_event_source_get_event(s), &iteration);
+      /* The iteration dispatching this signal is not counted */
+      auto minutes{(monotonic_usec() - info.idle_usec) / 60e6};
+      sd_journal_print(LOG_INFO, "Idle for %.1f s, %.2f wakeup(s) per minute.",
+                       minutes * 60,
+                       (iteration - info.idle_iteration - 1) / minutes);
+    }
+  } catch (const std::exception& e) {
+    sd_journal_print(LOG_ERR, "Unable to dump source statistics: %s",
+                     e.what());
+  }
+
+  return 0;
+}
+
+#ifndef DEBUG
+/**
+ * Commit the LED output settings to the LEDs, through the io_uring backend
+ * if it is used, which must then be the only writer of the LEDs.
+ *
+ * \param info handler context.
+ * \throws std::system_error on error while writing to the LEDs.
+ */
+static void
+commit(e131_blinkt::handler_info& info)
+{
+  if (info.uring)
+    info.uring->commit();
+  else
+    info.blinkt.commit();
+}
+
+/**
+ * Set the global brightness of every LED, which the LEDs always share.
+ *
+ * \param blinkt LEDs.
+ * \param brt global brightness, in range [0, 0x1f].
+ * \return whether the brightness changed.
+ */
+static bool
+set_brightness(e131_blinkt::blinkt_type& blinkt, std::uint8_t brt) noexcept
+{
+  if (blinkt[0].brt == brt) return false;
+  for (std::size_t i{0}; i < blinkt.size(); i++) {
+    auto pixel{blinkt[i]};
+    pixel.brt = brt;
+    blinkt.set(i, pixel);
+  }
+  return true;
+}
+#endif
+
+/**
+ * Convert the DMX data of the universe into LED output settings, and commit
+ * them to the LEDs if any has changed.
+ *
+ * \param info handler context.
+ * \throws std::system_error on error while writing to the LEDs.
+ */
+static void
+render(e131_blinkt::handler_info& info)
+{
+  if (!info.rendered) {
+    info.rendered = true;
+    sd_journal_print(LOG_INFO, "First frame received %.3f ms after startup.",
+                     (monotonic_usec() - info.startup_usec) / 1000.0);
+  }
+#ifndef DEBUG
+  using e131_blinkt::blinkt_type;
+  using e131_blinkt::limiter_type;
+  loop_watchdog::watchdog::stage timing{*info.watchdog, "LED output"};
+  auto& blinkt{info.blinkt};
+  auto updated{false};
+  const auto& channel_data{info.player ? info.player->frame()
+                                       : info.uni.dmx_data()};
+  const auto* pixel_data{channel_data.data() + info.channel_offset};
+  /*
+   * The current is summed in the conversion pass, which keeps the global
+   * brightness of the strip; limiting changes it once the sum is known.
+   */
+  limiter_type::sum_type current{};
+  for (std::size_t i{0}; i < blinkt.size(); i++) {
+    const auto red{pixel_data[i * 3]};
+    const auto green{pixel_data[(i * 3) + 1]};
+    const auto blue{pixel_data[(i * 3) + 2]};
+    info.limiter.accumulate(current, red, green, blue);
+    const auto& target{blinkt_type::chip_type::make_pixel(blinkt[i].brt, red,
+                                                          green, blue)};
+    if (target != blinkt[i]) {
+      blinkt.set(i, target);
+      updated = true;
+    }
+  }
+  if (set_brightness(blinkt, info.limiter.brightness(current)))
+    updated = true;
+  E131_TRACE(frame_converted, info.uni.universe_number(), info.channel_offset,
+             3 * blinkt.size(), updated);
+  if (updated) commit(info);
+#else
+  std::cerr << "DMX data updated" << std::endl;
+#endif
+}
+
+/**
+ * Report the number of sources tracked by the universe, and their
+ * statistics, to the service manager.
+ *
+ * \param info handler context.
+ */
+static void
+notify_status(e131_blinkt::handler_info& info)
+{
+  /* Formatted on the stack, as it is refreshed while data is received */
+  std::array<char, 4096> status;
+  const auto& uni{info.uni};
+  std::size_t used(
+      std::snprintf(status.data(), status.size(),
+                    "STATUS=%d output source(s) (priority: %d, total: %d)",
+                    uni.prio_tracker().sources(),
+                    static_cast<int>(uni.prio_tracker()),
+                    uni.prio_tracker().total_sources()));
+  uni.for_each_source([&status, &used](const auto& uuid, const auto& stats) {
+    if (used >= status.size()) return;
+    used += std::snprintf(
+        status.data() + used, status.size() - used,
+        "; %s: %.3g packet(s)/s, jitter %.3g ms, %llu sequence gap(s)",
+        e131_receiver::cid_str(uuid).c_str(), stats.rate(),
+        stats.jitter / 1000,
+        static_cast<unsigned long long>(stats.sequence_gaps));
+  });
+  sd_notify(0, status.data());
+  info.status_usec = monotonic_usec();
+}
+
+/**
+ * Enter or leave the idle state, in which no source is tracked.
+ *
+ * Source timers and the relay timer are disabled by the time the daemon
+ * is idle. On entering the idle state, the lag measurement timer is slowed
+ * down to the service manager watchdog interval, and the LEDs are blanked
+ * once, so that nothing wakes the daemon until a source appears, and the
+ * service manager told so.
+ *
+ * \param info handler context.
+ * \param ev event loop.
+ * \param idle whether no source is tracked.
+ * \param blank whether to blank the LEDs on entering the idle state.
+ * \throws std::system_error on error while writing to the LEDs.
+ */
+static void
+set_idle(e131_blinkt::handler_info& info, sd_event* ev, bool idle, bool blank)
+{
+  if (idle == info.idle) return;
+
+  info.idle = idle;
+  info.watchdog->set_idle(idle);
+  if (!idle) return;
+
+  info.idle_usec = monotonic_usec();
+  sd_event_get_iteration(ev, &info.idle_iteration);
+  if (!blank) return;
+#ifndef DEBUG
+  /* Black, with the global brightness left at its maximum */
+  info.blinkt.fill(
+      e131_blinkt::blinkt_type::chip_type::make_pixel(0x1f, 0, 0, 0));
+  commit(info);
+#else
+  std::cerr << "LEDs blanked" << std::endl;
+#endif
+  sd_notify(0, "STATUS=Awaiting data sources, LEDs blanked.");
+}
+
+static int
+monitor_sigusr1_handler(sd_event_source* s, const struct signalfd_siginfo* si,
+                        void* userdata)
+{
+  auto& info{*reinterpret_cast<e131_blinkt::monitor_info* const>(userdata)};
+  auto& mon{info.mon};
+
+  sd_journal_print(LOG_INFO, "%zu universe(s) active.", mon.active_universes());
+  mon.for_each([](const e131_monitor::universe_state& uni) {
+    double rate{0};
+    for (auto* src{uni.first}; src; src = src->next) rate += src->stats.rate();
+    sd_journal_print(LOG_INFO,
+                     "Universe %u: %d source(s), priority %d, "
+                     "%.1f packet(s)/s, %llu packet(s)",
+                     static_cast<unsigned int>(uni.number), uni.sources,
+                     static_cast<int>(uni.prio), rate,
+                     static_cast<unsigned long long>(uni.packets));
+  });
+  info.watchdog.log_histogram();
+
+  return 0;
+}
+
+/**
+ * Run the daemon in monitor mode, tracking every universe until terminated.
+ *
+ * \param ev event loop, with termination signals already handled.
+ * \param settings configuration settings.
+ * \return exit status.
+ * \throws std::system_error on system failures.
+ */
+static int
+run_monitor(sd_event* ev, const e131_blinkt::config_settings& settings)
+{
+  int r;
+  e131_monitor::monitor mon{ev, settings.monitor.groups,
+                            settings.e131.max_sources,
+                            settings.e131.receive_batch};
+  loop_watchdog::watchdog watchdog{ev, settings.watchdog.max_lag,
+                                   settings.watchdog.slow_stage};
+  e131_blinkt::monitor_info info{mon, watchdog};
+
+  if ((r = sd_event_add_signal(ev, nullptr, SIGUSR1, monitor_sigusr1_handler,
+                               &info)) < 0)
+    throw std::system_error{-r, std::system_category()};
+
+  sd_notify(0, "READY=1\nSTATUS=Monitoring all universes.");
+  sd_journal_print(LOG_INFO, "monitoring DMX data for all universes");
+
+  if ((r = sd_event_loop(ev)) < 0) {
+    sd_journal_print(LOG_CRIT, "Error running the event loop: %s",
+                     strerror(-r));
+    return EXIT_FAILURE;
+  }
+  return r;
+}
+
+/**
+ * Process the updates of the universe: source changes, and new DMX data.
+ *
+ * \param info handler context.
+ * \param ev_loop event loop.
+ * \param dispatch whether to run the event loop of the universe, or only to
+ *        process the packets passed to it by the io_uring backend.
+ * \return whether sources were added or removed, whose timers are only
+ *         armed by running the event loop of the universe.
+ * \throws std::exception on error while receiving or writing to the LEDs.
+ */
+static bool
+process_updates(e131_blinkt::handler_info& info, sd_event* ev_loop,
+                bool dispatch = true)
 {
-  using namespace e131_blinkt;
-  using uni_type   = e131_receiver::universe;
   using event_type = e131_receiver::update_event::event_type;
-  auto& info{*reinterpret_cast<handler_info* const>(userdata)};
-  uni_type& uni{info.uni};
+  auto& uni{info.uni};
   static bool limit_reached{false};
+
+  loop_watchdog::watchdog::stage timing{*info.watchdog, "E1.31 receive"};
+  auto allocations{heap_counter::allocations()};
+  const auto& events{dispatch ? uni.update() : uni.flush()};
+  auto update_status{false};
+  for (const auto& event : events) {
+    switch (event.event) {
+    case event_type::CHANNEL_DATA_UPDATED:
+      if (info.recorder) info.recorder->record(uni.dmx_data());
+      if (info.relay) {
+        loop_watchdog::watchdog::stage relay_timing{*info.watchdog,
+                                                    "relay send"};
+        info.relay->send(uni.dmx_data(), uni.prio_tracker());
+      }
+      if (info.bus) info.bus->publish(uni.dmx_data(), uni.prio_tracker());
+      render(info);
+      break;
+    case event_type::SOURCE_ADDED:
+      sd_journal_print(LOG_INFO, "Source %s added to universe.",
+                       e131_receiver::cid_str(event.id).c_str());
+      limit_reached = false;
+      update_status = true;
+      break;
+    case event_type::SOURCE_REMOVED:
+      sd_journal_print(LOG_INFO, "Source %s removed from universe.",
+                       e131_receiver::cid_str(event.id).c_str());
+      if (info.relay && !uni.prio_tracker().total_sources())
+        info.relay->stop();
+      limit_reached = false;
+      update_status = true;
+      break;
+    case event_type::SOURCE_LIMIT_REACHED:
+      if (!limit_reached) {
+        sd_journal_print(LOG_INFO,
+                         "Source %s "
+                         "not added to universe: source limit reached",
+                         e131_receiver::cid_str(event.id).c_str());
+        limit_reached = true;
+      }
+      break;
+    }
+  }
+  if (update_status ||
+      (!events.empty() &&
+       ((monotonic_usec() - info.status_usec) >= status_interval)))
+    notify_status(info);
+  if (update_status)
+    set_idle(info, ev_loop, !uni.prio_tracker().total_sources(), true);
+
+  /* DMX data alone is processed without allocating, from preallocated state */
+  if (!update_status && !info.allocation_logged &&
+      (heap_counter::allocations() != allocations)) {
+    sd_journal_print(LOG_WARNING, "Memory allocated processing DMX data.");
+    info.allocation_logged = true;
+  }
+  return update_status;
+}
+
+static int
+sighup_handler(sd_event_source* s, const struct signalfd_siginfo* si,
+               void* userdata)
+{
+  using namespace e131_blinkt;
+  auto& reload{*reinterpret_cast<reload_info* const>(userdata)};
+  auto& current{reload.settings};
+  auto& uni{reload.info.uni};
+
+  sd_notify(0, "RELOADING=1");
+  try {
+    loop_watchdog::watchdog::stage timing{*reload.info.watchdog,
+                                          "configuration reload"};
+    libconfig::Config config{};
+    config.readFile(reload.config_path.c_str());
+    config_settings updated{config, current.blinkt.path};
+
+    /* Settings bound to sockets are only applied on restart */
+    if ((updated.e131.reuse_port != current.e131.reuse_port) ||
+        (updated.e131.receive_batch != current.e131.receive_batch) ||
+        (updated.artnet.enabled != current.artnet.enabled) ||
+        (updated.artnet.priority != current.artnet.priority) ||
+        (updated.ddp.enabled != current.ddp.enabled) ||
+        (updated.discovery.listen != current.discovery.listen) ||
+        (updated.discovery.announce != current.discovery.announce) ||
+        (updated.relay.destinations != current.relay.destinations) ||
+        (updated.relay.max_rate != current.relay.max_rate) ||
+        (updated.bus.socket != current.bus.socket) ||
+        (updated.realtime.enabled != current.realtime.enabled) ||
+        (updated.realtime.priority != current.realtime.priority) ||
+        (updated.realtime.cpus != current.realtime.cpus) ||
+        (updated.busy_poll.usec != current.busy_poll.usec) ||
+        (updated.busy_poll.prefer != current.busy_poll.prefer) ||
+        (updated.busy_poll.spin != current.busy_poll.spin) ||
+        (updated.io_uring.enabled != current.io_uring.enabled) ||
+        (updated.io_uring.entries != current.io_uring.entries))
+      sd_journal_print(LOG_WARNING, "Some changed settings only take effect "
+                                    "after a restart.");
+
+    /* Only these steps can fail, and leave the universe as it was if so */
+    uni.reserve_sources(updated.e131.max_sources);
+    uni.set_universe(updated.e131.universe);
+    /* No source timer is left to wake the universe for the removals */
+    if (updated.e131.universe != current.e131.universe)
+      process_updates(reload.info, sd_event_source_get_event(s), false);
+
+    if (reload.info.relay && (updated.e131.universe != current.e131.universe))
+      reload.info.relay->set_universe(updated.e131.universe);
+    if (reload.info.announcer)
+      reload.info.announcer->set_universe(updated.e131.universe);
+    if (reload.info.bus) reload.info.bus->set_universe(updated.e131.universe);
+    uni.set_max_sources(updated.e131.max_sources);
+    uni.set_ignore_preview_flag(updated.e131.ignore_preview_flag);
+    uni.set_merge_mode(updated.e131.merge);
+    reload.info.channel_offset = updated.e131.offset;
 #ifndef DEBUG
-  auto& blinkt{info.blinkt};
+    reload.info.limiter = make_limiter(updated);
 #endif
+    reload.info.watchdog->set_limits(updated.watchdog.max_lag,
+                                     updated.watchdog.slow_stage);
+
+    updated.e131.reuse_port    = current.e131.reuse_port;
+    updated.e131.receive_batch = current.e131.receive_batch;
+    updated.artnet             = current.artnet;
+    updated.ddp                = current.ddp;
+    updated.discovery          = current.discovery;
+    updated.relay              = current.relay;
+    updated.bus                = current.bus;
+    updated.realtime           = current.realtime;
+    updated.busy_poll          = current.busy_poll;
+    updated.io_uring           = current.io_uring;
+    current                    = updated;
+
+    if (!reload.info.idle) render(reload.info);
+    notify_status(reload.info);
+    sd_journal_print(LOG_INFO,
+                     "Configuration reloaded, listening for DMX data "
+                     "addressed to universe %d",
+                     current.e131.universe);
+  } catch (const std::exception& e) {
+    sd_journal_print(LOG_ERR, "Unable to reload configuration: %s", e.what());
+  }
+  sd_notify(0, "READY=1");
+
+  return 0;
+}
+
+static int
+reset_handler(sd_event_source* s, void* userdata)
+{
+#ifndef DEBUG
+  auto& info{*reinterpret_cast<e131_blinkt::handler_info*>(userdata)};
+
+  try {
+    if (!info.rendered) commit(info);
+  } catch (const std::exception& e) {
+    sd_journal_print(LOG_CRIT, "Unable to reset LEDs: %s", e.what());
+    sd_event_exit(sd_event_source_get_event(s), EXIT_FAILURE);
+  }
+#endif
+
+  return 0;
+}
+
+static int
+play_handler(sd_event_source* s, std::uint64_t usec, void* userdata)
+{
+  auto& info{*reinterpret_cast<e131_blinkt::handler_info*>(userdata)};
+  std::uint64_t deadline;
+
+  try {
+    loop_watchdog::watchdog::stage timing{*info.watchdog, "show playback"};
+    render(info);
+    if (info.relay)
+      info.relay->send(info.player->frame(), e131_receiver::default_priority);
+    if (info.bus)
+      info.bus->publish(info.player->frame(), e131_receiver::default_priority);
+    if (!info.player->next(deadline)) {
+      sd_journal_print(LOG_INFO, "Show playback finished.");
+      return 0;
+    }
+  } catch (const std::exception& e) {
+    sd_journal_print(LOG_CRIT, "Exception playing show: %s", e.what());
+    sd_event_exit(sd_event_source_get_event(s), EXIT_FAILURE);
+    return 0;
+  }
+
+  sd_event_source_set_time(s, deadline);
+  sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+  return 0;
+}
+
+static int
+universe_handler(sd_event_source* s, int fd, uint32_t revents, void* userdata)
+{
+  auto& info{*reinterpret_cast<e131_blinkt::handler_info* const>(userdata)};
   auto* const ev_loop{sd_event_source_get_event(s)};
 
   try {
@@ -53,59 +523,7 @@ universe_handler(sd_event_source* s, int fd, uint32_t revents, void* userdata)
       sd_journal_print(LOG_CRIT, "Error event on E1.31 socket");
       throw std::runtime_error{"Error event on E1.31 socket"};
     }
-    const auto& events{uni.update()};
-    auto update_status{false};
-    for (const auto& event : events) {
-      switch (event.event) {
-      case event_type::CHANNEL_DATA_UPDATED: {
-#ifndef DEBUG
-        auto updated{false};
-        const auto& channel_data{uni.dmx_data()};
-        for (int i{info.channel_offset}; i < blinkt.size(); i++) {
-          const auto& target{apa102::make_output(0x1f, channel_data[i * 3],
-                                                 channel_data[(i * 3) + 1],
-                                                 channel_data[(i * 3) + 2])};
-          if (target != blinkt[i]) {
-            blinkt.set(i, target);
-            updated = true;
-          }
-        }
-        if (updated) blinkt.commit();
-#else
-        std::cerr << "DMX data updated" << std::endl;
-#endif
-      } break;
-      case event_type::SOURCE_ADDED:
-        sd_journal_print(LOG_INFO, "Source %s added to universe.",
-                         e131_receiver::cid_str(event.id).c_str());
-        limit_reached = false;
-        update_status = true;
-        break;
-      case event_type::SOURCE_REMOVED:
-        sd_journal_print(LOG_INFO, "Source %s removed from universe.",
-                         e131_receiver::cid_str(event.id).c_str());
-        limit_reached = false;
-        update_status = true;
-        break;
-      case event_type::SOURCE_LIMIT_REACHED:
-        if (!limit_reached) {
-          sd_journal_print(LOG_INFO,
-                           "Source %s "
-                           "not added to universe: source limit reached",
-                           e131_receiver::cid_str(event.id).c_str());
-          limit_reached = true;
-        }
-        break;
-      }
-    }
-    if (update_status) {
-      std::stringstream ss{};
-      ss << "STATUS=" << uni.prio_tracker().sources() << " output source(s) "
-         << "(priority: " << static_cast<int>(uni.prio_tracker())
-         << ", total: " << uni.prio_tracker().total_sources() << ")"
-         << "\n";
-      sd_notify(0, ss.str().c_str());
-    }
+    process_updates(info, ev_loop);
   } catch (const std::exception& e) {
     sd_journal_print(LOG_CRIT,
                      "Exception processing data from E1.31 "
@@ -117,12 +535,84 @@ universe_handler(sd_event_source* s, int fd, uint32_t revents, void* userdata)
   return 0;
 }
 
+/**
+ * Run the event loop until it exits, without ever sleeping in it, and
+ * receive DMX data straight from the sockets between its iterations.
+ *
+ * The loop only sleeps while the daemon is idle, so that the CPU it spins
+ * on is not kept busy with nothing to receive.
+ *
+ * \param ev_loop event loop.
+ * \param info handler context.
+ * \return exit status.
+ */
+static int
+spin_loop(sd_event* ev_loop, e131_blinkt::handler_info& info)
+{
+  int r;
+  int code{EXIT_FAILURE};
+
+  while (sd_event_get_state(ev_loop) != SD_EVENT_FINISHED) {
+    try {
+      if (!info.idle && info.uni.receive()) process_updates(info, ev_loop);
+    } catch (const std::exception& e) {
+      sd_journal_print(LOG_CRIT,
+                       "Exception processing data from E1.31 "
+                       "socket: %s",
+                       e.what());
+      sd_event_exit(ev_loop, EXIT_FAILURE);
+    }
+
+    if ((r = sd_event_run(ev_loop, info.idle ? UINT64_MAX : 0)) < 0) {
+      sd_journal_print(LOG_CRIT, "Error running the event loop: %s",
+                       strerror(-r));
+      return EXIT_FAILURE;
+    }
+  }
+
+  sd_event_get_exit_code(ev_loop, &code);
+  return code;
+}
+
+/**
+ * Run the event loop until it exits, with E1.31 packets received and the
+ * LEDs written through the io_uring backend, which runs the event loop
+ * whenever it has events pending.
+ *
+ * \param ev_loop event loop.
+ * \param info handler context.
+ * \param backend io_uring backend.
+ * \return exit status.
+ */
+static int
+uring_loop(sd_event* ev_loop, e131_blinkt::handler_info& info,
+           uring_backend::backend& backend)
+{
+  int code{EXIT_FAILURE};
+
+  while (sd_event_get_state(ev_loop) != SD_EVENT_FINISHED) {
+    try {
+      if (backend.run() && process_updates(info, ev_loop, false))
+        process_updates(info, ev_loop);
+    } catch (const std::exception& e) {
+      sd_journal_print(LOG_CRIT, "Error running the io_uring backend: %s",
+                       e.what());
+      return EXIT_FAILURE;
+    }
+  }
+
+  sd_event_get_exit_code(ev_loop, &code);
+  return code;
+}
+
 int
 main(int argc, char** argv)
 {
   using namespace e131_blinkt;
   using namespace e131_receiver;
 
+  auto startup_usec{monotonic_usec()};
+
   try {
     const auto& arguments{
         docopt::docopt(cmd_help, {argv + 1, argv + argc}, true, "1.0.0")};
@@ -138,6 +628,7 @@ main(int argc, char** argv)
 
     sigset_t set;
     if (sigemptyset(&set) || sigaddset(&set, SIGTERM) ||
+        sigaddset(&set, SIGUSR1) || sigaddset(&set, SIGHUP) ||
         sigprocmask(SIG_BLOCK, &set, nullptr)) {
       sd_journal_print(LOG_CRIT,
                        "Unable to setup initial signal "
@@ -166,31 +657,182 @@ main(int argc, char** argv)
       throw std::system_error{-r, std::system_category()};
     }
 
+    if (arguments.at("--monitor").asBool())
+      return run_monitor(ev_loop.get(), user_settings);
+
     e131_receiver::universe uni{user_settings.e131.max_sources,
                                 user_settings.e131.ignore_preview_flag,
-                                user_settings.e131.universe};
+                                user_settings.e131.universe,
+                                user_settings.e131.reuse_port,
+                                user_settings.e131.receive_batch,
+                                user_settings.e131.merge};
+    if (user_settings.artnet.enabled)
+      uni.enable_artnet(user_settings.artnet.priority);
+    if (user_settings.busy_poll.usec)
+      uni.enable_busy_poll(user_settings.busy_poll.usec,
+                           user_settings.busy_poll.prefer);
+
 #ifndef DEBUG
-    apa102::apa102 blinkt{user_settings.blinkt.path, 100, 8, true};
-    handler_info info{uni, blinkt, user_settings.e131.offset};
+    blinkt_type blinkt{user_settings.blinkt.path, 100,
+                       !user_settings.blinkt.deferred_reset};
+    handler_info info{uni, blinkt, user_settings.e131.offset, startup_usec,
+                      make_limiter(user_settings)};
+
+    /* DDP addresses the pixels directly, bypassing DMX arbitration */
+    std::unique_ptr<ddp_receiver::receiver> ddp;
+    if (user_settings.ddp.enabled)
+      ddp = std::make_unique<ddp_receiver::receiver>(
+          ev_loop.get(),
+          [&blinkt, &info](std::size_t offset, const std::uint8_t* data,
+                           std::size_t length, bool push) {
+            /* Offsets are sender-controlled, and may be beyond the strip */
+            constexpr std::size_t channels{3 * blinkt_type::size()};
+            if (offset < channels) {
+              length = std::min(length, channels - offset);
+              for (std::size_t i{offset}; i < (offset + length); i++) {
+                auto target{blinkt[i / 3]};
+                switch (i % 3) {
+                case 0: target.red = data[i - offset]; break;
+                case 1: target.green = data[i - offset]; break;
+                case 2: target.blue = data[i - offset]; break;
+                }
+                blinkt.set(i / 3, target);
+              }
+            }
+            if (!push) return;
+            /* DDP data bypasses render(), but not the current limiter */
+            std::array<std::uint8_t, channels> rgb;
+            for (std::size_t i{0}; i < blinkt.size(); i++) {
+              rgb[i * 3]       = blinkt[i].red;
+              rgb[(i * 3) + 1] = blinkt[i].green;
+              rgb[(i * 3) + 2] = blinkt[i].blue;
+            }
+            set_brightness(blinkt, info.limiter.brightness(rgb.data()));
+            commit(info);
+          });
 #else
-    handler_info info{uni};
+    handler_info info{uni, user_settings.e131.offset, startup_usec};
 #endif
+    info.watchdog = std::make_unique<loop_watchdog::watchdog>(
+        ev_loop.get(), user_settings.watchdog.max_lag,
+        user_settings.watchdog.slow_stage);
+
+    if ((r = sd_event_add_signal(ev_loop.get(), nullptr, SIGUSR1,
+                                 sigusr1_handler, &info)) < 0) {
+      sd_journal_print(LOG_CRIT, "Unable to add SIGUSR1 to event loop: %s",
+                       strerror(-r));
+      throw std::system_error{-r, std::system_category()};
+    }
+
+    reload_info reload{arguments.at("--config").asString(), user_settings,
+                       info};
+    if ((r = sd_event_add_signal(ev_loop.get(), nullptr, SIGHUP,
+                                 sighup_handler, &reload)) < 0) {
+      sd_journal_print(LOG_CRIT, "Unable to add SIGHUP to event loop: %s",
+                       strerror(-r));
+      throw std::system_error{-r, std::system_category()};
+    }
+
+    if (user_settings.discovery.listen) uni.enable_discovery();
+    if (user_settings.discovery.announce)
+      info.announcer = std::make_unique<e131_relay::announcer>(
+          ev_loop.get(), user_settings.e131.universe);
+
+    if (!user_settings.relay.destinations.empty())
+      info.relay = std::make_unique<e131_relay::relay>(
+          ev_loop.get(), user_settings.e131.universe,
+          user_settings.relay.destinations, user_settings.relay.max_rate);
+
+    if (!user_settings.bus.socket.empty())
+      info.bus = std::make_unique<frame_bus::publisher>(
+          ev_loop.get(), user_settings.bus.socket, user_settings.e131.universe);
 
-    if ((r = sd_event_add_io(ev_loop.get(), nullptr, uni.event_fd(),
-                             EPOLLIN | EPOLLHUP | EPOLLERR, universe_handler,
-                             &info)) < 0) {
+    if (arguments.at("--record").isString())
+      info.recorder = std::make_unique<show_file::recorder>(
+          arguments.at("--record").asString());
+
+    /* Shows are played back in place of the DMX data received */
+    std::uint64_t deadline;
+    if (arguments.at("--play").isString()) {
+      info.player = std::make_unique<show_file::player>(
+          arguments.at("--play").asString());
+      info.player->start(monotonic_usec());
+      if (info.player->next(deadline) &&
+          ((r = sd_event_add_time(ev_loop.get(), nullptr, CLOCK_MONOTONIC,
+                                  deadline, 1, play_handler, &info)) < 0)) {
+        sd_journal_print(LOG_CRIT, "Unable to add show playback to event "
+                                   "loop: %s",
+                         strerror(-r));
+        throw std::system_error{-r, std::system_category()};
+      }
+    } else if ((r = sd_event_add_io(ev_loop.get(), nullptr, uni.event_fd(),
+                                    EPOLLIN | EPOLLHUP | EPOLLERR,
+                                    universe_handler, &info)) < 0) {
       sd_journal_print(LOG_CRIT,
                        "Unable to add E1.31 universe object to event loop: %s",
                        strerror(-r));
       throw std::system_error{-r, std::system_category()};
     }
 
+    /* Blank the LEDs once the daemon is ready, ahead of any E1.31 data */
+    std::unique_ptr<sd_event_source, deleters::sd_event_source> reset_evs;
+    if (user_settings.blinkt.deferred_reset) {
+      sd_event_source* evs{nullptr};
+      r = sd_event_add_defer(ev_loop.get(), &evs, reset_handler, &info);
+      reset_evs.reset(evs);
+      if ((r < 0) || ((r = sd_event_source_set_priority(
+                           evs, SD_EVENT_PRIORITY_IMPORTANT)) < 0)) {
+        sd_journal_print(LOG_CRIT, "Unable to add LED reset to event loop: %s",
+                         strerror(-r));
+        throw std::system_error{-r, std::system_category()};
+      }
+    }
+
+    /* Falls back to the event loop, which still receives, on failure */
+    std::unique_ptr<uring_backend::backend> uring;
+    if (user_settings.io_uring.enabled && !info.player) {
+      try {
+        uring = std::make_unique<uring_backend::backend>(
+            uni, ev_loop.get(), user_settings.io_uring.entries);
+#ifndef DEBUG
+        uring->set_output(blinkt.device(),
+                          [&blinkt]() -> const std::vector<iovec>& {
+                            return blinkt.prepare();
+                          });
+#endif
+        info.uring = uring.get();
+        sd_journal_print(LOG_INFO, "Receiving through io_uring.");
+      } catch (const std::exception& e) {
+        sd_journal_print(LOG_WARNING,
+                         "Unable to set up io_uring, receiving through the "
+                         "event loop: %s",
+                         e.what());
+      }
+    }
+
+    /* Everything used in the steady state has been allocated by now */
+    if (user_settings.realtime.enabled) {
+      enter_realtime(user_settings.realtime.priority,
+                     user_settings.realtime.cpus);
+      sd_journal_print(LOG_INFO, "Running with SCHED_FIFO priority %d.",
+                       user_settings.realtime.priority);
+    }
+    info.ready_faults      = minor_faults();
+    info.ready_allocations = heap_counter::allocations();
+    if (!info.player) set_idle(info, ev_loop.get(), true, false);
+
     sd_notify(0, "READY=1\nSTATUS=Awaiting data sources.");
+    sd_journal_print(LOG_INFO, "Ready %.3f ms after startup.",
+                     (monotonic_usec() - startup_usec) / 1000.0);
 
     sd_journal_print(LOG_INFO,
                      "listening for DMX data addressed to universe %d",
                      user_settings.e131.universe);
 
+    if (user_settings.busy_poll.spin && !info.player)
+      return spin_loop(ev_loop.get(), info);
+    if (uring) return uring_loop(ev_loop.get(), info, *uring);
+
     if ((r = sd_event_loop(ev_loop.get())) < 0) {
       sd_journal_print(LOG_CRIT, "Error running the event loop: %s",
                        strerror(-r));
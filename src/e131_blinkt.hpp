@@ -9,27 +9,43 @@
 #ifndef E131_BLINKT_HPP_
 #define E131_BLINKT_HPP_
 
-#include <apa102.hpp>
+#include <array>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <ddp_receiver.hpp>
 #include <deleters.hpp>
 #include <docopt/docopt.h>
+#include <e131_monitor.hpp>
 #include <e131_receiver.hpp>
+#include <e131_relay.hpp>
 #include <fcntl.h>
+#include <frame_bus.hpp>
+#include <heap_counter.hpp>
 #include <iostream>
+#include <led_strip.hpp>
 #include <libconfig.h++>
 #include <limits>
+#include <loop_watchdog.hpp>
+#include <malloc.h>
 #include <map>
 #include <memory>
+#include <show_file.hpp>
+#include <sched.h>
 #include <sstream>
 #include <string>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <system_error>
 #include <systemd/sd-daemon.h>
 #include <systemd/sd-event.h>
 #include <systemd/sd-journal.h>
+#include <time.h>
 #include <unistd.h>
+#include <uring_backend.hpp>
+#include <vector>
 
 /**
  * Utility functionality for e131_blinkt.
@@ -44,7 +60,8 @@ struct config_settings {
    * Blinkt-device specific configuration.
    */
   struct {
-    std::string path; ///< Path to SPI device for Blinkt.
+    std::string path;           ///< Path to SPI device for Blinkt.
+    bool deferred_reset{false}; ///< Blank LEDs only once ready.
   } blinkt;
 
   /**
@@ -58,8 +75,101 @@ struct config_settings {
     int max_sources;          ///< Maximum number of sources
     int offset;               ///< Pixel data channel number offset.
     bool ignore_preview_flag; ///< Preview flag ignore.
+    bool reuse_port{false};   ///< Share the E1.31 port with other instances.
+    int receive_batch{16};    ///< Packets dequeued per receive call.
+    /** Policy used to combine data from sources at the same priority. */
+    e131_receiver::merge_mode merge{e131_receiver::merge_mode::ltp};
   } e131;
 
+  /**
+   * Art-Net specific configuration.
+   */
+  struct {
+    bool enabled{false}; ///< Whether to accept Art-Net data.
+    int priority{100};   ///< Priority assigned to Art-Net sources.
+  } artnet;
+
+  /**
+   * DDP specific configuration.
+   */
+  struct {
+    bool enabled{false}; ///< Whether to accept DDP data.
+  } ddp;
+
+  /**
+   * E1.31 universe discovery specific configuration.
+   */
+  struct {
+    bool listen{false};   ///< Whether to track announcing sources.
+    bool announce{false}; ///< Whether to announce the watched universe.
+  } discovery;
+
+  /**
+   * E1.31 relay specific configuration.
+   */
+  struct {
+    std::vector<std::string> destinations{}; ///< Unicast destinations.
+    int max_rate{44}; ///< Packets sent to a destination per second.
+  } relay;
+
+  /**
+   * Monitor mode specific configuration.
+   */
+  struct {
+    std::vector<int> groups{}; ///< Universes whose groups to join.
+  } monitor;
+
+  /**
+   * Shared-memory frame bus specific configuration.
+   */
+  struct {
+    std::string socket{}; ///< Unix socket handing out the bus.
+  } bus;
+
+  /**
+   * Low-latency mode specific configuration.
+   */
+  struct {
+    bool enabled{false};     ///< Whether to run with real-time scheduling.
+    int priority{10};        ///< SCHED_FIFO priority.
+    std::vector<int> cpus{}; ///< CPUs to pin the daemon to.
+  } realtime;
+
+  /**
+   * Busy-poll receive mode specific configuration.
+   */
+  struct {
+    int usec{0};        ///< Time to busy poll the E1.31 socket for, in us.
+    bool prefer{false}; ///< Whether to prefer busy polling to interrupts.
+    bool spin{false};   ///< Whether to spin on the sockets instead of sleeping.
+  } busy_poll;
+
+  /**
+   * io_uring receive and output mode specific configuration.
+   */
+  struct {
+    bool enabled{false}; ///< Whether to receive and output through io_uring.
+    int entries{64};     ///< Ring size, and number of receive buffers.
+  } io_uring;
+
+  /**
+   * Event loop watchdog specific configuration.
+   */
+  struct {
+    int max_lag{100};   ///< Longest lag still feeding the watchdog, in ms.
+    int slow_stage{20}; ///< Longest stage not logged as slow, in ms.
+  } watchdog;
+
+  /**
+   * Current limiter specific configuration.
+   */
+  struct {
+    int budget{0}; ///< Current budget in mA, 0 to disable.
+    int red{20};   ///< Red channel current at full output, in mA.
+    int green{20}; ///< Green channel current at full output, in mA.
+    int blue{20};  ///< Blue channel current at full output, in mA.
+  } limiter;
+
   /* This simply contains base data types, so... */
   config_settings() = default;
   /* Allow implicit default move constructor */
@@ -73,6 +183,7 @@ struct config_settings {
    *             e131_blinkt configuration file.
    * \param path path to GPIO character device to use for driving Blinkt.
    * \throws SettingNotFoundException on missing settings.
+   * \throws std::runtime_error on invalid settings.
    */
   explicit config_settings(const libconfig::Config& conf,
                            const std::string& path);
@@ -100,20 +211,120 @@ operator<<(std::ostream& ost, const config_settings& settings);
 std::ostream&
 operator<<(std::ostream& ost, std::map<std::string, docopt::value> m);
 
+/**
+ * Switch the daemon to the low-latency mode: SCHED_FIFO scheduling,
+ * optionally pinned to a set of CPUs, with all of its memory locked.
+ *
+ * To be called once every buffer has been allocated. Freed heap memory is
+ * kept mapped afterwards, so that it is reused without faulting.
+ *
+ * \param priority SCHED_FIFO priority.
+ * \param cpus CPUs to run on, or empty to run on any CPU.
+ * \throws std::system_error on system failures.
+ */
+void
+enter_realtime(int priority, const std::vector<int>& cpus);
+
+/**
+ * Obtain the number of minor page faults taken by the daemon, which grows
+ * whenever memory that was not yet mapped is touched.
+ *
+ * \return fault count.
+ */
+long
+minor_faults() noexcept;
+
+/**
+ * Driver for the Blinkt!, a strip of 8 APA102 LEDs.
+ */
+using blinkt_type = led_strip::strip<led_strip::apa102, 8>;
+
+/**
+ * Current limiter for the Blinkt!.
+ */
+using limiter_type = led_strip::current_limiter<blinkt_type::size()>;
+
+/**
+ * Create the current limiter described by configuration settings.
+ *
+ * \param settings configuration settings.
+ * \return current limiter.
+ */
+inline limiter_type
+make_limiter(const config_settings& settings) noexcept
+{
+  return limiter_type{static_cast<std::uint32_t>(settings.limiter.budget),
+                      static_cast<std::uint8_t>(settings.limiter.red),
+                      static_cast<std::uint8_t>(settings.limiter.green),
+                      static_cast<std::uint8_t>(settings.limiter.blue)};
+}
+
 /**
  * Context structure passed to the E1.31 socket data ready handler.
  */
 #ifndef DEBUG
 struct handler_info {
   e131_receiver::universe& uni; ///< Reference to universe object
-  apa102::apa102& blinkt;       ///< Reference to Blinkt handle
+  blinkt_type& blinkt;          ///< Reference to Blinkt handle
   int channel_offset;           ///< Pixel data channel offset
+  std::uint64_t startup_usec;   ///< Monotonic time of daemon startup
+  limiter_type limiter;         ///< Current limiter
+  bool rendered{false};         ///< Whether a frame has been rendered
+  long ready_faults{0};         ///< Minor page faults at readiness
+  unsigned long ready_allocations{0}; ///< Heap allocations at readiness
+  bool allocation_logged{false};      ///< Whether data allocated memory
+  bool idle{false};             ///< Whether no source is tracked
+  std::uint64_t idle_usec{0};   ///< Monotonic time idling started
+  std::uint64_t idle_iteration{0}; ///< Event loop iteration idling started
+  std::uint64_t status_usec{0};    ///< Monotonic time of the last status
+  std::unique_ptr<show_file::recorder> recorder{}; ///< Show being recorded
+  std::unique_ptr<show_file::player> player{};     ///< Show being played
+  std::unique_ptr<e131_relay::relay> relay{};      ///< Unicast relay
+  std::unique_ptr<e131_relay::announcer> announcer{}; ///< Discovery sender
+  std::unique_ptr<frame_bus::publisher> bus{};        ///< Shared frame bus
+  std::unique_ptr<loop_watchdog::watchdog>
+      watchdog{}; ///< Event loop watchdog
+  uring_backend::backend* uring{nullptr}; ///< io_uring backend, if used
 };
 #else
 struct handler_info {
   e131_receiver::universe& uni;
+  int channel_offset;
+  std::uint64_t startup_usec;
+  bool rendered{false};
+  long ready_faults{0};
+  unsigned long ready_allocations{0};
+  bool allocation_logged{false};
+  bool idle{false};
+  std::uint64_t idle_usec{0};
+  std::uint64_t idle_iteration{0};
+  std::uint64_t status_usec{0};
+  std::unique_ptr<show_file::recorder> recorder{};
+  std::unique_ptr<show_file::player> player{};
+  std::unique_ptr<e131_relay::relay> relay{};
+  std::unique_ptr<e131_relay::announcer> announcer{};
+  std::unique_ptr<frame_bus::publisher> bus{};
+  std::unique_ptr<loop_watchdog::watchdog> watchdog{};
+  uring_backend::backend* uring{nullptr};
 };
 #endif
+
+/**
+ * Context structure passed to the configuration reload handler.
+ */
+struct reload_info {
+  const std::string config_path; ///< Path to the configuration file
+  config_settings& settings;     ///< Settings currently in effect
+  handler_info& info;            ///< E1.31 socket data ready handler context
+};
+
+/**
+ * Context structure passed to the monitor mode statistics handler.
+ */
+struct monitor_info {
+  e131_monitor::monitor& mon;        ///< Monitor tracking all universes
+  loop_watchdog::watchdog& watchdog; ///< Event loop watchdog
+};
 } // namespace e131_blinkt
 
 #endif /* E131_BLINKT_HPP_ */
@@ -12,11 +12,117 @@ namespace e131_blinkt
 
 config_settings::config_settings(const libconfig::Config& conf,
                                  const std::string& path)
-    : blinkt{path}, e131{conf.lookup("e131_blinkt.e131.universe"),
-                         conf.lookup("e131_blinkt.e131.max_sources"),
-                         conf.lookup("e131_blinkt.e131.offset"),
-                         conf.lookup("e131_blinkt.e131.ignore_preview_flag")}
+    : blinkt{path, false},
+      e131{conf.lookup("e131_blinkt.e131.universe"),
+           conf.lookup("e131_blinkt.e131.max_sources"),
+           conf.lookup("e131_blinkt.e131.offset"),
+           conf.lookup("e131_blinkt.e131.ignore_preview_flag")}
 {
+  if ((e131.offset < 0) ||
+      ((e131.offset + (3 * blinkt_type::size())) >
+       std::tuple_size_v<e131_receiver::universe::channel_data_type>))
+    throw std::runtime_error{"invalid DMX channel offset"};
+
+  /* Optional settings, left at their defaults when absent */
+  conf.lookupValue("e131_blinkt.blinkt.deferred_reset", blinkt.deferred_reset);
+  conf.lookupValue("e131_blinkt.e131.reuse_port", e131.reuse_port);
+  conf.lookupValue("e131_blinkt.e131.receive_batch", e131.receive_batch);
+
+  std::string merge{"ltp"};
+  conf.lookupValue("e131_blinkt.e131.merge", merge);
+  if (merge == "ltp")
+    e131.merge = e131_receiver::merge_mode::ltp;
+  else if (merge == "htp")
+    e131.merge = e131_receiver::merge_mode::htp;
+  else
+    throw std::runtime_error{"invalid merge mode: " + merge};
+
+  conf.lookupValue("e131_blinkt.artnet.enabled", artnet.enabled);
+  conf.lookupValue("e131_blinkt.artnet.priority", artnet.priority);
+  conf.lookupValue("e131_blinkt.ddp.enabled", ddp.enabled);
+
+  conf.lookupValue("e131_blinkt.discovery.listen", discovery.listen);
+  conf.lookupValue("e131_blinkt.discovery.announce", discovery.announce);
+
+  if (conf.exists("e131_blinkt.relay.destinations")) {
+    const auto& hosts{conf.lookup("e131_blinkt.relay.destinations")};
+    for (int i{0}; i < hosts.getLength(); i++)
+      relay.destinations.emplace_back(static_cast<const char*>(hosts[i]));
+  }
+  conf.lookupValue("e131_blinkt.relay.max_rate", relay.max_rate);
+
+  if (conf.exists("e131_blinkt.monitor.groups")) {
+    const auto& groups{conf.lookup("e131_blinkt.monitor.groups")};
+    for (int i{0}; i < groups.getLength(); i++) {
+      int group{groups[i]};
+      if ((group < 1) || (group > e131_monitor::max_universe))
+        throw std::runtime_error{"invalid monitor universe"};
+      monitor.groups.push_back(group);
+    }
+  }
+
+  conf.lookupValue("e131_blinkt.bus.socket", bus.socket);
+
+  conf.lookupValue("e131_blinkt.realtime.enabled", realtime.enabled);
+  conf.lookupValue("e131_blinkt.realtime.priority", realtime.priority);
+  if ((realtime.priority < sched_get_priority_min(SCHED_FIFO)) ||
+      (realtime.priority > sched_get_priority_max(SCHED_FIFO)))
+    throw std::runtime_error{"invalid realtime priority"};
+  if (conf.exists("e131_blinkt.realtime.cpus")) {
+    const auto& cpus{conf.lookup("e131_blinkt.realtime.cpus")};
+    for (int i{0}; i < cpus.getLength(); i++) {
+      int cpu{cpus[i]};
+      if ((cpu < 0) || (cpu >= CPU_SETSIZE))
+        throw std::runtime_error{"invalid realtime CPU"};
+      realtime.cpus.push_back(cpu);
+    }
+  }
+
+  conf.lookupValue("e131_blinkt.busy_poll.usec", busy_poll.usec);
+  conf.lookupValue("e131_blinkt.busy_poll.prefer", busy_poll.prefer);
+  conf.lookupValue("e131_blinkt.busy_poll.spin", busy_poll.spin);
+  if (busy_poll.usec < 0)
+    throw std::runtime_error{"invalid busy poll duration"};
+  /*
+   * Spinning under SCHED_FIFO starves the network softirqs sharing its
+   * core, so another core must be left to them.
+   */
+  if (busy_poll.spin && realtime.enabled) {
+    cpu_set_t allowed;
+    cpu_set_t pinned;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+      throw std::system_error{errno, std::system_category()};
+    CPU_ZERO(&pinned);
+    for (const auto& cpu : realtime.cpus) CPU_SET(cpu, &pinned);
+    CPU_AND(&pinned, &pinned, &allowed);
+    if (!CPU_COUNT(&pinned) || (CPU_COUNT(&pinned) >= CPU_COUNT(&allowed)))
+      throw std::runtime_error{"spinning with realtime scheduling requires "
+                               "realtime CPUs leaving a core free"};
+  }
+
+  conf.lookupValue("e131_blinkt.io_uring.enabled", io_uring.enabled);
+  conf.lookupValue("e131_blinkt.io_uring.entries", io_uring.entries);
+  if ((io_uring.entries < 1) || (io_uring.entries > 32768) ||
+      (io_uring.entries & (io_uring.entries - 1)))
+    throw std::runtime_error{"invalid io_uring size"};
+  /* Spinning polls the sockets directly, leaving nothing to the ring */
+  if (io_uring.enabled && busy_poll.spin)
+    throw std::runtime_error{"io_uring cannot be combined with spinning"};
+
+  conf.lookupValue("e131_blinkt.watchdog.max_lag", watchdog.max_lag);
+  conf.lookupValue("e131_blinkt.watchdog.slow_stage", watchdog.slow_stage);
+  if ((watchdog.max_lag <= 0) || (watchdog.slow_stage <= 0))
+    throw std::runtime_error{"invalid watchdog bound"};
+
+  conf.lookupValue("e131_blinkt.limiter.budget", limiter.budget);
+  conf.lookupValue("e131_blinkt.limiter.red", limiter.red);
+  conf.lookupValue("e131_blinkt.limiter.green", limiter.green);
+  conf.lookupValue("e131_blinkt.limiter.blue", limiter.blue);
+  if ((limiter.budget < 0) || (limiter.budget >= (1 << 24)))
+    throw std::runtime_error{"invalid current budget"};
+  for (auto channel : {limiter.red, limiter.green, limiter.blue})
+    if ((channel < 0) || (channel > 0xff))
+      throw std::runtime_error{"invalid channel current"};
 }
 
 std::ostream&
@@ -25,6 +131,7 @@ operator<<(std::ostream& ost, const config_settings& settings)
   ost << "Configuration settings:" << std::endl;
   ost << "Blinkt settings:" << std::endl;
   ost << "\tSPI device: " << settings.blinkt.path << std::endl;
+  ost << "\tDeferred reset: " << settings.blinkt.deferred_reset << std::endl;
 
   ost << "E1.31 settings:" << std::endl;
   ost << "\tUniverse: " << settings.e131.universe << std::endl;
@@ -32,9 +139,100 @@ operator<<(std::ostream& ost, const config_settings& settings)
   ost << "\tDMX channel offset: " << settings.e131.offset << std::endl;
   ost << "\tPreview flag ignored: " << settings.e131.ignore_preview_flag
       << std::endl;
+  ost << "\tPort shared: " << settings.e131.reuse_port << std::endl;
+  ost << "\tReceive batch: " << settings.e131.receive_batch << std::endl;
+  ost << "\tMerge mode: "
+      << ((settings.e131.merge == e131_receiver::merge_mode::htp) ? "htp"
+                                                                  : "ltp")
+      << std::endl;
+
+  ost << "Art-Net settings:" << std::endl;
+  ost << "\tEnabled: " << settings.artnet.enabled << std::endl;
+  ost << "\tPriority: " << settings.artnet.priority << std::endl;
+
+  ost << "DDP settings:" << std::endl;
+  ost << "\tEnabled: " << settings.ddp.enabled << std::endl;
+
+  ost << "Discovery settings:" << std::endl;
+  ost << "\tListen: " << settings.discovery.listen << std::endl;
+  ost << "\tAnnounce: " << settings.discovery.announce << std::endl;
+
+  ost << "Relay settings:" << std::endl;
+  ost << "\tDestinations:";
+  for (const auto& host : settings.relay.destinations) ost << " " << host;
+  ost << std::endl;
+  ost << "\tMax rate: " << settings.relay.max_rate << std::endl;
+
+  ost << "Monitor settings:" << std::endl;
+  ost << "\tGroups:";
+  for (const auto& group : settings.monitor.groups) ost << " " << group;
+  ost << std::endl;
+
+  ost << "Frame bus settings:" << std::endl;
+  ost << "\tSocket: " << settings.bus.socket << std::endl;
+
+  ost << "Realtime settings:" << std::endl;
+  ost << "\tEnabled: " << settings.realtime.enabled << std::endl;
+  ost << "\tPriority: " << settings.realtime.priority << std::endl;
+  ost << "\tCPUs:";
+  for (const auto& cpu : settings.realtime.cpus) ost << " " << cpu;
+  ost << std::endl;
+
+  ost << "Busy poll settings:" << std::endl;
+  ost << "\tDuration: " << settings.busy_poll.usec << std::endl;
+  ost << "\tPrefer: " << settings.busy_poll.prefer << std::endl;
+  ost << "\tSpin: " << settings.busy_poll.spin << std::endl;
+
+  ost << "io_uring settings:" << std::endl;
+  ost << "\tEnabled: " << settings.io_uring.enabled << std::endl;
+  ost << "\tEntries: " << settings.io_uring.entries << std::endl;
+
+  ost << "Watchdog settings:" << std::endl;
+  ost << "\tMax lag: " << settings.watchdog.max_lag << std::endl;
+  ost << "\tSlow stage: " << settings.watchdog.slow_stage << std::endl;
+
+  ost << "Current limiter settings:" << std::endl;
+  ost << "\tBudget: " << settings.limiter.budget << std::endl;
+  ost << "\tChannel currents: " << settings.limiter.red << " "
+      << settings.limiter.green << " " << settings.limiter.blue << std::endl;
   return ost;
 }
 
+void
+enter_realtime(int priority, const std::vector<int>& cpus)
+{
+  if (!cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const auto& cpu : cpus) CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1)
+      throw std::system_error{errno, std::system_category()};
+  }
+
+  sched_param param{};
+  param.sched_priority = priority;
+  if (sched_setscheduler(0, SCHED_FIFO, &param) == -1)
+    throw std::system_error{errno, std::system_category()};
+
+  /* Keep freed memory in the heap instead of returning it to the kernel */
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+    throw std::system_error{errno, std::system_category()};
+
+  /* Fault in the stack that deeper call chains use later on */
+  volatile std::uint8_t stack[64 * 1024];
+  for (std::size_t i{0}; i < sizeof(stack); i += 4096) stack[i] = 0;
+}
+
+long
+minor_faults() noexcept
+{
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_minflt;
+}
+
 std::ostream&
 operator<<(std::ostream& ost, std::map<std::string, docopt::value> m)
 {
@@ -0,0 +1,134 @@
+/**
+ * \file e131_merger.cpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <e131_merger.hpp>
+
+namespace e131_receiver
+{
+
+merger::merger(std::size_t sources)
+{
+  grow(sources);
+}
+
+merger::slot_type
+merger::acquire(std::uint8_t prio) noexcept
+{
+  slot_type s{vacant.back()};
+  vacant.pop_back();
+  active.push_back(s);
+
+  slab[s].levels.fill(0);
+  slab[s].channel_priorities = false;
+  slab[s].priorities.fill(rank(prio));
+  dirty = true;
+  return s;
+}
+
+void
+merger::release(slot_type s)
+{
+  active.erase(std::find(active.begin(), active.end(), s));
+  vacant.push_back(s);
+  dirty = true;
+}
+
+void
+merger::grow(std::size_t sources)
+{
+  if (sources <= slab.size()) return;
+
+  std::size_t previous{slab.size()};
+  slab.resize(sources);
+  active.reserve(sources);
+  vacant.reserve(sources);
+  for (std::size_t i{sources}; i > previous; i--) vacant.push_back(i - 1);
+}
+
+void
+merger::clear() noexcept
+{
+  vacant.insert(vacant.end(), active.begin(), active.end());
+  active.clear();
+  dirty = true;
+}
+
+void
+merger::set_priority(slot_type s, std::uint8_t prio) noexcept
+{
+  auto& sl{slab[s]};
+  if (sl.channel_priorities) return;
+
+  sl.priorities.fill(rank(prio));
+  dirty = true;
+}
+
+void
+merger::set_levels(slot_type s, const std::uint8_t* data,
+                   std::size_t count) noexcept
+{
+  auto& levels{slab[s].levels};
+  count = std::min(count, levels.size());
+
+  if (!std::memcmp(levels.data(), data, count) &&
+      std::all_of(levels.begin() + count, levels.end(),
+                  [](auto level) { return !level; }))
+    return;
+
+  std::copy(data, data + count, levels.begin());
+  std::fill(levels.begin() + count, levels.end(), 0);
+  dirty = true;
+}
+
+void
+merger::set_channel_priorities(slot_type s, const std::uint8_t* data,
+                               std::size_t count) noexcept
+{
+  auto& sl{slab[s]};
+  count = std::min(count, sl.priorities.size());
+
+  sl.channel_priorities = true;
+  for (std::size_t i{0}; i < count; i++)
+    sl.priorities[i] = data[i] ? rank(data[i]) : 0;
+  std::fill(sl.priorities.begin() + count, sl.priorities.end(), 0);
+  dirty = true;
+}
+
+bool
+merger::merge(channel_data_type& out) noexcept
+{
+  if (!dirty) return false;
+
+  /*
+   * Both passes are plain element-wise max operations over fixed-size
+   * byte arrays, written without branches so that they are vectorized.
+   */
+  top.fill(0);
+  for (auto s : active) {
+    const auto& prio{slab[s].priorities};
+    for (std::size_t i{0}; i < top.size(); i++)
+      top[i] = std::max(top[i], prio[i]);
+  }
+
+  out.fill(0);
+  for (auto s : active) {
+    const auto& prio{slab[s].priorities};
+    const auto& levels{slab[s].levels};
+    for (std::size_t i{0}; i < out.size(); i++) {
+      std::uint8_t mask{static_cast<std::uint8_t>(
+          -((prio[i] == top[i]) & (prio[i] != 0)))};
+      out[i] = std::max(out[i], static_cast<std::uint8_t>(levels[i] & mask));
+    }
+  }
+
+  dirty = false;
+  return true;
+}
+} // namespace e131_receiver
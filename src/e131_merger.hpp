@@ -0,0 +1,174 @@
+/**
+ * \file e131_merger.hpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#ifndef E131_MERGER_HPP_
+#define E131_MERGER_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace e131_receiver
+{
+/**
+ * DMX start code identifying a packet of DMX level data.
+ */
+constexpr std::uint8_t null_start_code{0x00};
+
+/**
+ * DMX start code identifying a packet of per-channel priorities.
+ */
+constexpr std::uint8_t priority_start_code{0xdd};
+
+/**
+ * Policy used to combine DMX data from sources at the same priority.
+ */
+enum class merge_mode {
+  ltp, ///< Latest takes precedence, the whole universe at a time.
+  htp, ///< Highest takes precedence, channel by channel.
+};
+
+/**
+ * Merges DMX data from multiple sources, channel by channel.
+ *
+ * Each source is assigned a slot in a fixed-size slab, holding the last DMX
+ * levels and per-channel priorities received from the source. A channel
+ * takes its value from the sources at the highest priority for that
+ * channel, and the highest level among those sources wins.
+ *
+ * Priorities are stored offset by one, with zero reserved for channels a
+ * source does not contribute to.
+ */
+class merger
+{
+public:
+  using channel_data_type = std::array<std::uint8_t, 512>;
+  using slot_type         = std::size_t;
+
+private:
+  /**
+   * Data kept for a single source.
+   */
+  struct slot {
+    channel_data_type levels{};     ///< Last DMX levels
+    channel_data_type priorities{}; ///< Per-channel priorities, offset by one
+    bool channel_priorities{false}; ///< Per-channel priorities received
+  };
+
+  /**
+   * Convert an E1.31 priority to the value stored in a slot.
+   *
+   * \param prio E1.31 priority.
+   * \return stored priority, in range [1, 201].
+   */
+  static constexpr std::uint8_t
+  rank(std::uint8_t prio) noexcept
+  {
+    return ((prio > 200) ? 200 : prio) + 1;
+  }
+
+  std::vector<slot> slab;         ///< Slot storage
+  std::vector<slot_type> active;  ///< Slots in use
+  std::vector<slot_type> vacant;  ///< Slots available for use
+  channel_data_type top{};        ///< Highest priority of each channel
+  bool dirty{false};              ///< Merge result out of date
+
+public:
+  /**
+   * Construct a merger able to track a particular number of sources.
+   *
+   * \param sources maximum number of sources.
+   */
+  explicit merger(std::size_t sources);
+
+  /**
+   * Assign a slot to a new source.
+   *
+   * \param prio universe priority of the source.
+   * \return slot assigned.
+   * \pre fewer than the maximum number of sources hold slots.
+   */
+  slot_type
+  acquire(std::uint8_t prio) noexcept;
+
+  /**
+   * Release the slot assigned to a source.
+   *
+   * \param s slot to release.
+   */
+  void
+  release(slot_type s);
+
+  /**
+   * Increase the maximum number of sources that can be tracked.
+   *
+   * Slots in use are not affected. The slab never shrinks.
+   *
+   * \param sources maximum number of sources.
+   */
+  void
+  grow(std::size_t sources);
+
+  /**
+   * Release the slots assigned to all sources.
+   */
+  void
+  clear() noexcept;
+
+  /**
+   * Update the universe priority of a source.
+   *
+   * Ignored for sources that have sent per-channel priorities.
+   *
+   * \param s slot of the source.
+   * \param prio universe priority of the source.
+   */
+  void
+  set_priority(slot_type s, std::uint8_t prio) noexcept;
+
+  /**
+   * Update the DMX levels of a source.
+   *
+   * Channels not present in the update are set to zero.
+   *
+   * \param s slot of the source.
+   * \param data DMX levels, without the start code.
+   * \param count number of DMX levels, at most 512.
+   */
+  void
+  set_levels(slot_type s, const std::uint8_t* data,
+             std::size_t count) noexcept;
+
+  /**
+   * Update the per-channel priorities of a source.
+   *
+   * Channels not present in the update are not sourced.
+   *
+   * \param s slot of the source.
+   * \param data per-channel priorities, without the start code.
+   * \param count number of priorities, at most 512.
+   */
+  void
+  set_channel_priorities(slot_type s, const std::uint8_t* data,
+                         std::size_t count) noexcept;
+
+  /**
+   * Recompute merged DMX data, if any source has changed since the last
+   * merge.
+   *
+   * \param out merged DMX data.
+   * \retval true merged DMX data was recomputed.
+   * \retval false no source has changed, output left untouched.
+   */
+  bool
+  merge(channel_data_type& out) noexcept;
+};
+} // namespace e131_receiver
+
+#endif /* E131_MERGER_HPP_ */
@@ -0,0 +1,269 @@
+/**
+ * \file e131_monitor.cpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <e131_monitor.hpp>
+
+namespace e131_monitor
+{
+
+/**
+ * Interval between sweeps for timed out sources, in milliseconds.
+ */
+constexpr std::uint32_t sweep_interval{1000};
+
+universe_state&
+monitor::find_universe(std::uint16_t number)
+{
+  auto& page{index[number / page_size]};
+  if (!page) page = std::make_unique<page_type>();
+
+  auto*& state{(*page)[number % page_size]};
+  if (!state) {
+    /* Sources are only swept for while any universe is active */
+    if (!active) arm_sweep();
+    state         = universe_arena.acquire();
+    state->number = number;
+    state->next   = active;
+    active        = state;
+    active_count++;
+  }
+
+  return *state;
+}
+
+void
+monitor::sweep(std::uint64_t now) noexcept
+{
+  constexpr auto timeout{e131_receiver::ms_to_us<std::uint64_t>(
+      e131_receiver::network_data_loss_timeout)};
+
+  for (universe_state** uni_link{&active}; *uni_link;) {
+    auto* uni{*uni_link};
+    std::uint8_t prio{0};
+
+    for (source_state** src_link{&uni->first}; *src_link;) {
+      auto* src{*src_link};
+      if ((now > src->stats.last_arrival) &&
+          ((now - src->stats.last_arrival) > timeout)) {
+        *src_link = src->next;
+        source_arena.release(src);
+        uni->sources--;
+      } else {
+        prio     = std::max(prio, src->stats.prio);
+        src_link = &src->next;
+      }
+    }
+
+    /* Lower priority sources take over from those that timed out */
+    uni->prio = prio;
+    if (uni->sources) {
+      uni_link = &uni->next;
+      continue;
+    }
+
+    *uni_link = uni->next;
+    (*index[uni->number / page_size])[uni->number % page_size] = nullptr;
+    universe_arena.release(uni);
+    active_count--;
+  }
+}
+
+void
+monitor::process_packet(const std::uint8_t* pkt, std::size_t len,
+                        std::uint64_t arrival)
+{
+  e131_receiver::packet_view view{pkt, len};
+  if (!view.valid() || !view.universe() || (view.universe() > max_universe))
+    return;
+
+  auto& uni{find_universe(view.universe())};
+  auto* src{uni.first};
+  while (src && std::memcmp(src->uuid.data(), view.cid_data(), 16))
+    src = src->next;
+
+  if (src) {
+    int sequence_delta{
+        static_cast<std::int8_t>(view.sequence() - src->sequence)};
+    /* Out-of-order packets, per E1.31 section 6.7.2 */
+    if ((sequence_delta <= 0) && (sequence_delta > -20)) return;
+    /* Terminated sources are removed on the next sweep */
+    if (view.terminated()) {
+      src->stats.last_arrival = 0;
+      return;
+    }
+    src->stats.record(arrival, sequence_delta);
+  } else {
+    /* Universes created for rejected sources are removed on the next sweep */
+    if (view.terminated() || (uni.sources >= max_sources)) return;
+    src = source_arena.acquire();
+    std::memcpy(src->uuid.data(), view.cid_data(), src->uuid.size());
+    src->next = uni.first;
+    uni.first = src;
+    uni.sources++;
+    src->stats.record(arrival, 0);
+  }
+
+  src->sequence   = view.sequence();
+  src->stats.prio = view.priority();
+  uni.packets++;
+
+  if ((view.start_code() == e131_receiver::null_start_code) &&
+      !view.preview() && (view.priority() >= uni.prio)) {
+    std::copy(view.data(), view.data() + view.count(), uni.data.data());
+    uni.prio = view.priority();
+  }
+}
+
+int
+monitor::socket_callback(sd_event_source* s, int fd, std::uint32_t revents,
+                         void* userdata) noexcept
+{
+  auto& mon{*reinterpret_cast<monitor*>(userdata)};
+
+  try {
+    if (revents & EPOLLERR) throw std::runtime_error{"error on E1.31 socket"};
+    do {
+      for (auto& hdr : mon.rx_headers)
+        hdr.msg_hdr.msg_controllen = sizeof(rx_control);
+
+      int r{recvmmsg(fd, mon.rx_headers.data(), mon.rx_headers.size(), 0,
+                     nullptr)};
+      if (r == -1) {
+        if ((errno != EWOULDBLOCK) && (errno != EAGAIN))
+          throw std::system_error{errno, std::system_category()};
+        break;
+      }
+
+      auto clocks{e131_receiver::clock_reading::now()};
+      for (int i{0}; i < r; i++)
+        mon.process_packet(mon.rx_packets[i].data(), mon.rx_headers[i].msg_len,
+                           e131_receiver::universe::arrival_time(
+                               mon.rx_headers[i].msg_hdr, clocks));
+
+      /* A short batch means that the socket has been drained */
+      if (static_cast<std::size_t>(r) < mon.rx_headers.size()) break;
+    } while (true);
+  } catch (const std::exception& e) {
+    sd_journal_print(LOG_CRIT,
+                     "Exception processing data from E1.31 socket: %s",
+                     e.what());
+    sd_event_exit(sd_event_source_get_event(s), EXIT_FAILURE);
+    return -1;
+  }
+
+  return 0;
+}
+
+void
+monitor::arm_sweep()
+{
+  int r;
+  std::uint64_t now;
+  auto* s{sweep_evs.get()};
+
+  if (((r = sd_event_now(sd_event_source_get_event(s), CLOCK_MONOTONIC,
+                         &now)) < 0) ||
+      ((r = sd_event_source_set_time(
+            s, now + e131_receiver::ms_to_us<std::uint64_t>(sweep_interval))) <
+       0) ||
+      ((r = sd_event_source_set_enabled(s, SD_EVENT_ON)) < 0))
+    throw std::system_error{-r, std::system_category()};
+}
+
+int
+monitor::sweep_callback(sd_event_source* s, std::uint64_t usec,
+                        void* userdata) noexcept
+{
+  auto& mon{*reinterpret_cast<monitor*>(userdata)};
+  std::uint64_t now;
+
+  /* Arrival times are monotonic, so that clock steps expire nothing */
+  if (sd_event_now(sd_event_source_get_event(s), CLOCK_MONOTONIC, &now) < 0)
+    now = usec;
+  mon.sweep(now);
+
+  /* Left disarmed until a universe becomes active again */
+  if (!mon.active) {
+    sd_event_source_set_enabled(s, SD_EVENT_OFF);
+    return 0;
+  }
+
+  sd_event_source_set_time(
+      s, usec + e131_receiver::ms_to_us<std::uint64_t>(sweep_interval));
+  return 0;
+}
+
+monitor::monitor(e131_receiver::no_socket_t, sd_event* ev, int sources)
+    : max_sources{sources}
+{
+  int r;
+  sd_event_source* s;
+
+  if ((r = sd_event_add_time(ev, &s, CLOCK_MONOTONIC, 0,
+                             e131_receiver::ms_to_us<std::uint64_t>(100),
+                             sweep_callback, this)) < 0)
+    throw std::system_error{-r, std::system_category()};
+  sweep_evs.reset(s);
+
+  /* Armed by the first universe to become active */
+  if ((r = sd_event_source_set_enabled(s, SD_EVENT_OFF)) < 0)
+    throw std::system_error{-r, std::system_category()};
+}
+
+monitor::monitor(sd_event* ev, const std::vector<int>& groups, int sources,
+                 int receive_batch)
+    : monitor(e131_receiver::no_socket, ev, sources)
+{
+  int r;
+  int enable{1};
+  sd_event_source* s;
+  sockaddr_in addr{};
+
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htobe16(e131_receiver::e131_port);
+  addr.sin_addr.s_addr = htobe32(INADDR_ANY);
+
+  rx_packets.resize(std::max(receive_batch, 1));
+  rx_iovecs.resize(rx_packets.size());
+  rx_headers.resize(rx_packets.size());
+  rx_controls.resize(rx_packets.size());
+
+  e131_socket.reset(socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0));
+  if ((e131_socket == -1) ||
+      (setsockopt(e131_socket, SOL_SOCKET, SO_TIMESTAMPNS, &enable,
+                  sizeof(enable)) == -1) ||
+      (bind(e131_socket, reinterpret_cast<const sockaddr*>(&addr),
+            sizeof(addr)) == -1))
+    throw std::system_error{errno, std::system_category()};
+
+  for (const auto& group : groups) {
+    ip_mreqn req{};
+    /* E1.31 multicast addressing, 239.255.<universe high>.<universe low> */
+    req.imr_multiaddr.s_addr =
+        htobe32(UINT32_C(0xefff0000) | static_cast<std::uint16_t>(group));
+    req.imr_address.s_addr = htobe32(INADDR_ANY);
+
+    if (setsockopt(e131_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &req,
+                   sizeof(req)) == -1)
+      throw std::system_error{errno, std::system_category()};
+  }
+
+  for (std::size_t i{0}; i < rx_packets.size(); i++) {
+    rx_iovecs[i] = {rx_packets[i].data(), rx_packets[i].size()};
+    std::memset(&rx_headers[i], 0, sizeof(rx_headers[i]));
+    rx_headers[i].msg_hdr.msg_iov     = &rx_iovecs[i];
+    rx_headers[i].msg_hdr.msg_iovlen  = 1;
+    rx_headers[i].msg_hdr.msg_control = rx_controls[i].buf;
+  }
+
+  if ((r = sd_event_add_io(ev, &s, e131_socket, EPOLLIN | EPOLLERR,
+                           socket_callback, this)) < 0)
+    throw std::system_error{-r, std::system_category()};
+  socket_evs.reset(s);
+}
+} // namespace e131_monitor
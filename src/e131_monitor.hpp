@@ -0,0 +1,299 @@
+/**
+ * \file e131_monitor.hpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#ifndef E131_MONITOR_HPP_
+#define E131_MONITOR_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deleters.hpp>
+#include <e131_packet.hpp>
+#include <e131_receiver.hpp>
+#include <memory>
+#include <systemd/sd-event.h>
+#include <vector>
+
+/**
+ * Tracking of every E1.31 universe seen on the network, for troubleshooting
+ * and analysis.
+ */
+namespace e131_monitor
+{
+/**
+ * Highest universe number allowed for DMX data, ANSI E1.31-2016 section 9.1.
+ */
+constexpr std::uint16_t max_universe{63999};
+
+/**
+ * Allocator for objects of a single type, carved out of fixed-size chunks.
+ *
+ * Released objects are kept on a free list threaded through their \c next
+ * member, and reused before new chunks are allocated. Chunks are only freed
+ * along with the arena, so memory use follows the peak number of objects in
+ * use.
+ *
+ * \tparam T object type, with a \c next member pointing to a \c T.
+ * \tparam chunk_size number of objects per chunk.
+ */
+template<typename T, std::size_t chunk_size>
+class arena
+{
+private:
+  std::vector<std::unique_ptr<T[]>> chunks{}; ///< Allocated chunks
+  std::size_t used{chunk_size};               ///< Objects used in last chunk
+  T* free_list{nullptr};                      ///< Released objects
+
+public:
+  /**
+   * Obtain a value-initialized object.
+   *
+   * \return object.
+   * \throws std::bad_alloc on failure to allocate a new chunk.
+   */
+  T*
+  acquire()
+  {
+    T* obj;
+
+    if (free_list) {
+      obj       = free_list;
+      free_list = obj->next;
+    } else {
+      if (used == chunk_size) {
+        chunks.emplace_back(new T[chunk_size]);
+        used = 0;
+      }
+      obj = &chunks.back()[used++];
+    }
+
+    *obj = T{};
+    return obj;
+  }
+
+  /**
+   * Return an object to the arena.
+   *
+   * \param obj object obtained from \ref acquire().
+   */
+  void
+  release(T* obj) noexcept
+  {
+    obj->next = free_list;
+    free_list = obj;
+  }
+};
+
+/**
+ * State of a source sending to a universe.
+ */
+struct source_state {
+  std::array<std::uint8_t, 16> uuid{};      ///< Source CID
+  std::uint8_t sequence{0};                 ///< Sequence of the last packet
+  e131_receiver::source_statistics stats{}; ///< Running statistics
+  source_state* next{nullptr};              ///< Next source of the universe
+};
+
+/**
+ * State of a universe with at least one source.
+ */
+struct universe_state {
+  using channel_data_type = e131_receiver::universe::channel_data_type;
+
+  std::uint16_t number{0};       ///< Universe number
+  int sources{0};                ///< Number of sources
+  std::uint8_t prio{0};          ///< Priority of the latest data
+  std::uint64_t packets{0};      ///< Accepted packets
+  source_state* first{nullptr};  ///< Sources of the universe
+  channel_data_type data{};      ///< DMX data from the highest priority
+  universe_state* next{nullptr}; ///< Next active universe
+};
+
+/**
+ * Receives E1.31 data for every universe, keeping per-source statistics and
+ * the latest DMX data of each universe.
+ *
+ * Universes are found through a two-level index on the universe number,
+ * whose pages are allocated when the first universe they cover is seen.
+ * Universe and source state are allocated from arenas, and released when
+ * sources time out, so that memory use follows the number of active
+ * universes rather than the size of the universe space.
+ *
+ * Sources are expired by a single sweep timer rather than a timer per
+ * source, so that thousands of sources cost no more than one timer. The
+ * timer is disarmed while no universe is active.
+ */
+class monitor
+{
+public:
+  using channel_data_type = universe_state::channel_data_type;
+
+private:
+  /**
+   * Number of universes covered by a page of the index.
+   */
+  static constexpr std::size_t page_size{256};
+
+  using page_type = std::array<universe_state*, page_size>;
+
+  /**
+   * Ancillary data buffer holding the receive timestamp of a packet.
+   */
+  union rx_control {
+    cmsghdr header;
+    char buf[CMSG_SPACE(sizeof(timespec))];
+  };
+
+  std::array<std::unique_ptr<page_type>, (max_universe / page_size) + 1>
+      index{}; ///< Universe index, by page
+  arena<universe_state, 16> universe_arena{}; ///< Universe allocator
+  arena<source_state, 256> source_arena{};    ///< Source allocator
+  universe_state* active{nullptr};            ///< Active universes
+  std::size_t active_count{0};                ///< Active universe count
+  int max_sources;                            ///< Sources per universe
+  e131_receiver::unique_fd e131_socket;       ///< E1.31 socket fd
+  std::vector<e131_receiver::packet_buffer>
+      rx_packets{};                      ///< Receive buffers
+  std::vector<iovec> rx_iovecs{};        ///< Receive buffer vectors
+  std::vector<mmsghdr> rx_headers{};     ///< Receive msg headers
+  std::vector<rx_control> rx_controls{}; ///< Receive timestamps
+  std::unique_ptr<sd_event_source, deleters::sd_event_source>
+      socket_evs{}; ///< E1.31 socket event source
+  std::unique_ptr<sd_event_source, deleters::sd_event_source>
+      sweep_evs{}; ///< Source expiry timer
+
+  /**
+   * Find the state of a universe, creating it if it is not active.
+   *
+   * \param number universe number.
+   * \return universe state.
+   */
+  universe_state&
+  find_universe(std::uint16_t number);
+
+  /**
+   * Arm the sweep timer, to expire one sweep interval from now.
+   *
+   * \throws std::system_error on system failures.
+   */
+  void
+  arm_sweep();
+
+  /**
+   * Remove sources that have timed out, and universes left without sources.
+   *
+   * \param now current time, in microseconds of \c CLOCK_MONOTONIC.
+   */
+  void
+  sweep(std::uint64_t now) noexcept;
+
+  /**
+   * Callback to be called by the event loop when data has been received on
+   * the E1.31 socket.
+   *
+   * \see sd_event_add_io for more information regarding
+   *      function arguments.
+   * \retval 0 callback execution success.
+   * \retval nonzero callback execution failure.
+   */
+  static int
+  socket_callback(sd_event_source* s, int fd, std::uint32_t revents,
+                  void* userdata) noexcept;
+
+  /**
+   * Callback to be called by the event loop when sources are to be expired.
+   *
+   * \see sd_event_add_time for more information regarding
+   *      function arguments.
+   * \retval 0 callback execution success.
+   * \retval nonzero callback execution failure.
+   */
+  static int
+  sweep_callback(sd_event_source* s, std::uint64_t usec,
+                 void* userdata) noexcept;
+
+public:
+  /**
+   * Start monitoring.
+   *
+   * Data sent to any universe on the E1.31 port is tracked: unicast data,
+   * and multicast data for the groups joined here or by any other socket on
+   * the host.
+   *
+   * \param ev event loop to receive data on.
+   * \param groups universes whose multicast groups to join.
+   * \param sources maximum number of sources tracked per universe.
+   * \param receive_batch maximum number of packets to dequeue from the
+   *        E1.31 socket in a single system call.
+   * \throws std::system_error on system failures.
+   */
+  monitor(sd_event* ev, const std::vector<int>& groups, int sources,
+          int receive_batch);
+
+  /**
+   * Start monitoring without a socket, tracking only packets passed to
+   * \ref process_packet(), such as in benchmarks.
+   *
+   * \param ev event loop to expire sources on.
+   * \param sources maximum number of sources tracked per universe.
+   * \throws std::system_error on system failures.
+   */
+  monitor(e131_receiver::no_socket_t, sd_event* ev, int sources);
+  monitor(const monitor& other)  = delete;
+  monitor(const monitor&& other) = delete;
+  monitor&
+  operator=(const monitor& other) = delete;
+  monitor&
+  operator=(const monitor&& other) = delete;
+
+  /**
+   * Process a single E1.31 packet, as if it had been received on the E1.31
+   * socket.
+   *
+   * \param pkt received packet, which may be malformed or truncated.
+   * \param len number of bytes in the packet.
+   * \param arrival arrival time of the packet, in microseconds of
+   *        \c CLOCK_MONOTONIC.
+   * \throws std::bad_alloc on failure to allocate universe or source state.
+   * \throws std::system_error on failure to arm the sweep timer.
+   */
+  void
+  process_packet(const std::uint8_t* pkt, std::size_t len,
+                 std::uint64_t arrival);
+
+  /**
+   * Obtain the number of universes with at least one source.
+   *
+   * \return universe count.
+   */
+  std::size_t
+  active_universes() const noexcept
+  {
+    return active_count;
+  }
+
+  /**
+   * Call a function on every active universe, in ascending universe number
+   * order.
+   *
+   * \param f function called with a <tt>const universe_state&</tt>.
+   */
+  template<typename F>
+  void
+  for_each(F&& f) const
+  {
+    for (const auto& page : index) {
+      if (!page) continue;
+      for (const auto* state : *page)
+        if (state) f(*state);
+    }
+  }
+};
+} // namespace e131_monitor
+
+#endif /* E131_MONITOR_HPP_ */
@@ -0,0 +1,380 @@
+/**
+ * \file e131_packet.hpp
+ *
+ * Zero-copy view over a received E1.31 packet.
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#ifndef E131_PACKET_HPP_
+#define E131_PACKET_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace e131_receiver
+{
+/**
+ * UDP port on which E1.31 packets are received.
+ */
+constexpr std::uint16_t e131_port{5568};
+
+/**
+ * E1.31 Root Layer Protocol Vector representing a payload of E1.31 data.
+ */
+constexpr std::uint32_t e131_data_vector{0x00000004};
+
+/**
+ * E1.31 Root Layer Protocol Vector representing a payload of E1.31
+ * extended packets, such as universe discovery packets.
+ */
+constexpr std::uint32_t e131_extended_vector{0x00000008};
+
+/**
+ * Universe number whose multicast group carries universe discovery
+ * packets.
+ */
+constexpr std::uint16_t discovery_universe{64214};
+
+/**
+ * Interval at which universe discovery packets are sent, in milliseconds.
+ */
+constexpr std::uint32_t discovery_interval{10000};
+
+/**
+ * Preamble size, postamble size and ACN packet identifier, at the start of
+ * every E1.31 packet.
+ */
+constexpr std::array<std::uint8_t, 16> acn_preamble{
+    0x00, 0x10, 0x00, 0x00, 'A', 'S', 'C', '-',
+    'E',  '1',  '.',  '1',  '7', 0x00, 0x00, 0x00};
+
+/**
+ * Read a big-endian 16-bit field.
+ *
+ * \param p start of the field.
+ * \return field value.
+ */
+inline std::uint16_t
+read_be16(const std::uint8_t* p) noexcept
+{
+  return static_cast<std::uint16_t>((p[0] << 8) | p[1]);
+}
+
+/**
+ * Read a big-endian 32-bit field.
+ *
+ * \param p start of the field.
+ * \return field value.
+ */
+inline std::uint32_t
+read_be32(const std::uint8_t* p) noexcept
+{
+  return (std::uint32_t{p[0]} << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/**
+ * Largest E1.31 data packet: a 125-byte header, the DMX start code and 512
+ * DMX channels.
+ */
+constexpr std::size_t e131_packet_size{638};
+
+/**
+ * Buffer holding a received E1.31 packet.
+ */
+using packet_buffer = std::array<std::uint8_t, e131_packet_size>;
+
+/**
+ * Read-only view over an E1.31 data packet in a receive buffer.
+ *
+ * The packet is validated once on construction, and individual fields are
+ * only decoded when they are accessed. Accessors other than \ref valid()
+ * must only be used on valid packets.
+ *
+ * Offsets are from ANSI E1.31-2016, section 4.
+ */
+class packet_view
+{
+  const std::uint8_t* buf; ///< Start of the packet
+  std::size_t len;         ///< Number of bytes received
+  bool ok;                 ///< Whether the packet is a valid data packet
+
+  static constexpr std::size_t root_vector_offset{18};
+  static constexpr std::size_t cid_offset{22};
+  static constexpr std::size_t frame_vector_offset{40};
+  static constexpr std::size_t priority_offset{108};
+  static constexpr std::size_t sequence_offset{111};
+  static constexpr std::size_t options_offset{112};
+  static constexpr std::size_t universe_offset{113};
+  static constexpr std::size_t dmp_offset{117};
+  static constexpr std::size_t count_offset{123};
+  static constexpr std::size_t property_offset{125};
+
+  static constexpr std::uint32_t frame_data_vector{0x00000002};
+  static constexpr std::uint8_t option_preview{0x80};
+  static constexpr std::uint8_t option_terminated{0x40};
+
+  /**
+   * DMP vector, address and data type, first property address and address
+   * increment.
+   */
+  static constexpr std::array<std::uint8_t, 6> dmp_header{0x02, 0xa1, 0x00,
+                                                          0x00, 0x00, 0x01};
+
+  /**
+   * Validate the packet.
+   *
+   * All checks are evaluated without short-circuiting once the packet is
+   * known to hold a complete header, so validation costs the same for all
+   * such packets.
+   */
+  bool
+  validate() const noexcept
+  {
+    if (len < (property_offset + 1)) return false;
+
+    std::size_t count{read_be16(buf + count_offset)};
+    int bad{(std::memcmp(buf, acn_preamble.data(), acn_preamble.size()) != 0) |
+            (std::memcmp(buf + dmp_offset, dmp_header.data(),
+                         dmp_header.size()) != 0) |
+            (read_be32(buf + root_vector_offset) != e131_data_vector) |
+            (read_be32(buf + frame_vector_offset) != frame_data_vector) |
+            (count == 0) |
+            (count > (e131_packet_size - property_offset)) |
+            (count > (len - property_offset))};
+
+    return !bad;
+  }
+
+public:
+  /**
+   * Construct a view over a received packet.
+   *
+   * \param buffer start of the packet.
+   * \param length number of bytes received into the buffer.
+   */
+  packet_view(const std::uint8_t* buffer, std::size_t length) noexcept
+      : buf{buffer}, len{length}, ok{validate()}
+  {
+  }
+
+  /**
+   * Check whether the packet is a well-formed E1.31 data packet, holding
+   * at least the DMX start code.
+   *
+   * \return whether the packet is valid.
+   */
+  bool
+  valid() const noexcept
+  {
+    return ok;
+  }
+
+  /**
+   * Obtain the CID of the source of the packet.
+   *
+   * \return start of the 16-byte CID.
+   */
+  const std::uint8_t*
+  cid_data() const noexcept
+  {
+    return buf + cid_offset;
+  }
+
+  std::uint8_t
+  priority() const noexcept
+  {
+    return buf[priority_offset];
+  }
+
+  std::uint8_t
+  sequence() const noexcept
+  {
+    return buf[sequence_offset];
+  }
+
+  bool
+  preview() const noexcept
+  {
+    return buf[options_offset] & option_preview;
+  }
+
+  bool
+  terminated() const noexcept
+  {
+    return buf[options_offset] & option_terminated;
+  }
+
+  std::uint16_t
+  universe() const noexcept
+  {
+    return read_be16(buf + universe_offset);
+  }
+
+  std::uint8_t
+  start_code() const noexcept
+  {
+    return buf[property_offset];
+  }
+
+  /**
+   * Obtain the DMX channel data following the start code.
+   *
+   * \return start of the channel data.
+   */
+  const std::uint8_t*
+  data() const noexcept
+  {
+    return buf + property_offset + 1;
+  }
+
+  /**
+   * Obtain the number of DMX channels in the packet.
+   *
+   * \return channel count, excluding the start code.
+   */
+  std::size_t
+  count() const noexcept
+  {
+    return read_be16(buf + count_offset) - 1;
+  }
+};
+
+/**
+ * Read-only view over an E1.31 universe discovery packet in a receive
+ * buffer.
+ *
+ * Validated on construction like \ref packet_view. Offsets are from ANSI
+ * E1.31-2016, section 4.3.
+ */
+class discovery_view
+{
+  const std::uint8_t* buf; ///< Start of the packet
+  std::size_t universes;   ///< Number of universes listed
+  bool ok;                 ///< Whether the packet is a valid discovery packet
+
+  static constexpr std::size_t root_vector_offset{18};
+  static constexpr std::size_t cid_offset{22};
+  static constexpr std::size_t frame_vector_offset{40};
+  static constexpr std::size_t discovery_offset{112};
+  static constexpr std::size_t discovery_vector_offset{114};
+  static constexpr std::size_t page_offset{118};
+  static constexpr std::size_t last_page_offset{119};
+  static constexpr std::size_t list_offset{120};
+
+  static constexpr std::uint32_t frame_discovery_vector{0x00000002};
+  static constexpr std::uint32_t universe_list_vector{0x00000001};
+  static constexpr std::size_t max_universes{512};
+
+  /**
+   * Obtain the length of the universe discovery layer, from its flags and
+   * length field.
+   */
+  static std::size_t
+  layer_length(const std::uint8_t* buffer, std::size_t len) noexcept
+  {
+    return (len < list_offset) ? 0
+                               : (read_be16(buffer + discovery_offset) & 0x0fff);
+  }
+
+  bool
+  validate(std::size_t len) const noexcept
+  {
+    if (len < list_offset) return false;
+
+    std::size_t layer{layer_length(buf, len)};
+    int bad{(std::memcmp(buf, acn_preamble.data(), acn_preamble.size()) !=
+             0) |
+            (read_be32(buf + root_vector_offset) != e131_extended_vector) |
+            (read_be32(buf + frame_vector_offset) != frame_discovery_vector) |
+            (read_be32(buf + discovery_vector_offset) !=
+             universe_list_vector) |
+            (layer < (list_offset - discovery_offset)) |
+            (layer > (len - discovery_offset)) |
+            (universes > max_universes)};
+
+    return !bad;
+  }
+
+public:
+  /**
+   * Construct a view over a received packet.
+   *
+   * \param buffer start of the packet.
+   * \param length number of bytes received into the buffer.
+   */
+  discovery_view(const std::uint8_t* buffer, std::size_t length) noexcept
+      : buf{buffer},
+        universes{(std::max(layer_length(buffer, length),
+                            list_offset - discovery_offset) -
+                   (list_offset - discovery_offset)) /
+                  2},
+        ok{validate(length)}
+  {
+  }
+
+  /**
+   * Check whether the packet is a well-formed universe discovery packet.
+   *
+   * \return whether the packet is valid.
+   */
+  bool
+  valid() const noexcept
+  {
+    return ok;
+  }
+
+  /**
+   * Obtain the CID of the source of the packet.
+   *
+   * \return start of the 16-byte CID.
+   */
+  const std::uint8_t*
+  cid_data() const noexcept
+  {
+    return buf + cid_offset;
+  }
+
+  std::uint8_t
+  page() const noexcept
+  {
+    return buf[page_offset];
+  }
+
+  std::uint8_t
+  last_page() const noexcept
+  {
+    return buf[last_page_offset];
+  }
+
+  /**
+   * Obtain the number of universes listed in this page.
+   *
+   * \return universe count.
+   */
+  std::size_t
+  count() const noexcept
+  {
+    return universes;
+  }
+
+  /**
+   * Obtain a universe listed in this page.
+   *
+   * \param i index of the universe, below \ref count().
+   * \return universe number.
+   */
+  std::uint16_t
+  universe(std::size_t i) const noexcept
+  {
+    return read_be16(buf + list_offset + (2 * i));
+  }
+};
+} // namespace e131_receiver
+
+#endif /* E131_PACKET_HPP_ */
@@ -11,72 +11,88 @@
 namespace e131_receiver
 {
 
-std::string
-cid_str(const cid& uuid)
+cid_string
+cid_str(const cid& uuid) noexcept
 {
-  std::string s;
+  cid_string s{};
   static constexpr std::array<char, 16> hex_lut{'0', '1', '2', '3', '4', '5',
                                                 '6', '7', '8', '9', 'a', 'b',
                                                 'c', 'd', 'e', 'f'};
 
-  s.reserve(34);
-  s.append("0x");
+  auto* out{s.chars.data()};
+  *out++ = '0';
+  *out++ = 'x';
 
   for (const auto b : uuid) {
     std::uint8_t msnibble{static_cast<std::uint8_t>((b & 0xf0) >> 0x04)};
     std::uint8_t lsnibble{static_cast<std::uint8_t>(b & 0x0f)};
-    s.push_back(hex_lut[msnibble]);
-    s.push_back(hex_lut[lsnibble]);
+    *out++ = hex_lut[msnibble];
+    *out++ = hex_lut[lsnibble];
   }
 
   return s;
 }
 
-unique_fd::~unique_fd() noexcept
+void
+unique_fd::reset(int f) noexcept
 {
   if (fd != -1) close(fd);
+  fd = f;
 }
 
-priority::priority()
-{
-  prio_cnt[minimum_priority] = 1;
-}
-
-priority::operator priority::priority_type() const noexcept
+unique_fd::~unique_fd() noexcept
 {
-  return prio_cnt.crbegin()->first;
+  if (fd != -1) close(fd);
 }
 
 priority::priority_type
-priority::add(priority_type p)
+priority::add(priority_type p) noexcept
 {
   ++prio_cnt[p];
+  ++total;
+  top = std::max(top, p);
   return *this;
 }
 
 priority::priority_type
-priority::remove(priority_type p)
+priority::remove(priority_type p) noexcept
 {
   --prio_cnt[p];
-  if (prio_cnt[p] <= 0) prio_cnt.erase(p);
+  --total;
+  while ((top > minimum_priority) && !prio_cnt[top]) --top;
   return *this;
 }
 
 priority::count_type
-priority::sources() const noexcept
+priority::total_sources() const noexcept
 {
-  return (*this == minimum_priority) ? prio_cnt.rbegin()->second - 1
-                                     : prio_cnt.rbegin()->second;
+  return total;
 }
 
-priority::count_type
-priority::total_sources() const noexcept
+clock_reading
+clock_reading::now() noexcept
+{
+  timespec real;
+  timespec mono;
+
+  clock_gettime(CLOCK_REALTIME, &real);
+  clock_gettime(CLOCK_MONOTONIC, &mono);
+  return {(real.tv_sec * UINT64_C(1000000)) + (real.tv_nsec / 1000),
+          (mono.tv_sec * UINT64_C(1000000)) + (mono.tv_nsec / 1000)};
+}
+
+std::ostream&
+operator<<(std::ostream& ost, const source_statistics& stats)
 {
-  return (std::accumulate(prio_cnt.cbegin(), prio_cnt.cend(), count_type{},
-                          [](const auto& count, const auto& pair) {
-                            return (count + pair.second);
-                          }) -
-          1);
+  ost << "priority " << static_cast<int>(stats.prio) << ", "
+      << stats.rate() << " packet(s)/s, jitter " << (stats.jitter / 1000)
+      << " ms, " << stats.sequence_gaps << " sequence gap(s), "
+      << stats.packets << " packet(s)";
+  if (stats.priority_changed)
+    ost << ", priority changed "
+        << ((stats.last_arrival - stats.priority_changed) / 1000000)
+        << " s before last packet";
+  return ost;
 }
 
 channel_data_updated_event::channel_data_updated_event(const cid& uuid)
@@ -99,30 +115,47 @@ source_limit_reached_event::source_limit_reached_event(const cid& uuid)
 {
 }
 
-void
-universe::add_source(const cid& uuid, const e131_packet_t& pkt)
+source*
+universe::find_source(const cid& uuid) noexcept
 {
-  if (srcs.size() == max_sources) throw source_limit_reached_event{uuid};
+  for (auto i : active_srcs)
+    if (srcs[i].uuid == uuid) return &srcs[i];
+  return nullptr;
+}
+
+source&
+universe::add_source(const cid& uuid, const dmx_frame& frame)
+{
+  if ((active_srcs.size() >= static_cast<std::size_t>(max_sources)) ||
+      vacant_srcs.empty())
+    throw source_limit_reached_event{uuid};
 
   int r;
   std::uint64_t now;
-  if ((r = sd_event_now(ev.get(), CLOCK_MONOTONIC, &now)) < 0)
-    throw std::system_error{-r, std::system_category()};
-
-  sd_event_source* evs;
-  if ((r = sd_event_add_time(
-           ev.get(), &evs, CLOCK_MONOTONIC,
-           now + ms_to_us<std::uint64_t>(network_data_loss_timeout),
-           0, timer_callback, this)) < 0)
+  auto index{vacant_srcs.back()};
+  auto& src{srcs[index]};
+  if (((r = sd_event_now(ev.get(), CLOCK_MONOTONIC, &now)) < 0) ||
+      ((r = sd_event_source_set_time(
+            src.timer_evs.get(),
+            now + ms_to_us<std::uint64_t>(network_data_loss_timeout))) < 0) ||
+      ((r = sd_event_source_set_enabled(src.timer_evs.get(),
+                                        SD_EVENT_ONESHOT)) < 0))
     throw std::system_error{-r, std::system_category()};
 
-  prio.add(pkt.frame.priority);
-  srcs.try_emplace(
-      uuid,
-      source{uuid, pkt.frame.priority, pkt.frame.seq_number, 0,
-             std::unique_ptr<sd_event_source, deleters::sd_event_source>{evs}});
-  evs_cid.try_emplace(evs, uuid);
+  vacant_srcs.pop_back();
+  active_srcs.push_back(index);
+  prio.add(frame.prio);
+  src.uuid                     = uuid;
+  src.prio                     = frame.prio;
+  src.sequence_data            = frame.sequence;
+  src.sequence_synchronization = 0;
+  src.stats                    = source_statistics{};
+  if (merging == merge_mode::htp) src.slot = merge_engine.acquire(frame.prio);
+  src.stats.prio = src.prio;
+  src.stats.record(frame.arrival, 0);
   queued_events.push_back(source_added_event{uuid});
+  E131_TRACE(source_added, uni, trace::cid_hash(uuid.data()), frame.prio);
+  return src;
 }
 
 void
@@ -140,27 +173,123 @@ universe::source_timer_reset(const source& src)
 }
 
 void
-universe::remove_source(const source& src)
+universe::remove_source(source& src) noexcept
 {
-  auto uuid{src.uuid};
+  std::size_t index(&src - srcs.data());
 
   prio.remove(src.prio);
-  evs_cid.erase(src.timer_evs.get());
-  srcs.erase(src.uuid);
+  if (merging == merge_mode::htp) merge_engine.release(src.slot);
+  sd_event_source_set_enabled(src.timer_evs.get(), SD_EVENT_OFF);
+  *std::find(active_srcs.begin(), active_srcs.end(), index) =
+      active_srcs.back();
+  active_srcs.pop_back();
+  vacant_srcs.push_back(index);
+
+  queued_events.push_back(source_removed_event{src.uuid});
+  E131_TRACE(source_removed, uni, trace::cid_hash(src.uuid.data()));
+}
 
-  queued_events.push_back(source_removed_event{uuid});
+void
+universe::remove_all_sources() noexcept
+{
+  while (!active_srcs.empty()) remove_source(srcs[active_srcs.back()]);
 }
 
-auto
-universe::valid_packet(const e131_packet_t& pkt) const
+void
+universe::set_membership(int optname, std::uint16_t universe_num)
 {
-  if ((e131_pkt_validate(&pkt) == E131_ERR_NONE) &&
-      (be32toh(pkt.root.vector) == e131_data_vector) &&
-      (be16toh(pkt.frame.universe) == uni) &&
-      ((!e131_get_option(&pkt, E131_OPT_PREVIEW) || ignore_preview_flag)))
-    return true;
+  ip_mreqn req{};
+  /* E1.31 multicast addressing, 239.255.<universe high>.<universe low> */
+  req.imr_multiaddr.s_addr = htobe32(UINT32_C(0xefff0000) | universe_num);
+  req.imr_address.s_addr   = htobe32(INADDR_ANY);
+  req.imr_ifindex          = 0;
+
+  ipv6_mreq req6{};
+  auto& group{req6.ipv6mr_multiaddr.s6_addr};
+  /* IPv6 addressing, ff18::83:00:<universe high>:<universe low> */
+  group[0]              = 0xff;
+  group[1]              = 0x18;
+  group[9]              = 0x83;
+  group[13]             = static_cast<std::uint8_t>(universe_num >> 8);
+  group[15]             = static_cast<std::uint8_t>(universe_num);
+  req6.ipv6mr_interface = 0;
+
+  auto r{setsockopt(e131_socket, IPPROTO_IP, optname, &req, sizeof(req))};
+  auto ipv4_errno{errno};
+  if (dual_stack &&
+      (setsockopt(e131_socket, IPPROTO_IPV6,
+                  (optname == IP_ADD_MEMBERSHIP) ? IPV6_ADD_MEMBERSHIP
+                                                 : IPV6_DROP_MEMBERSHIP,
+                  &req6, sizeof(req6)) != -1))
+    return;
+
+  if (r == -1) throw std::system_error{ipv4_errno, std::system_category()};
+}
+
+void
+universe::attach_filter(int universe_num)
+{
+  /*
+   * Offsets are relative to the start of the UDP header, which is where
+   * socket filters on UDP sockets begin inspecting the datagram.
+   */
+  constexpr std::uint32_t udp_header_size{8};
+  constexpr std::uint32_t universe_offset{113};
+  constexpr std::uint32_t root_vector_offset{18};
+
+  std::vector<sock_filter> code{
+      BPF_STMT(BPF_LD | BPF_H | BPF_ABS, udp_header_size + universe_offset),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+               static_cast<std::uint32_t>(universe_num), 0, 1),
+      BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+  };
+  /* Discovery packets are only checked for once data packets are rejected */
+  if (discovery)
+    code.insert(code.end(),
+                {BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+                          udp_header_size + root_vector_offset),
+                 BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, e131_extended_vector, 0,
+                          1),
+                 BPF_STMT(BPF_RET | BPF_K, 0xffffffff)});
+  code.push_back(BPF_STMT(BPF_RET | BPF_K, 0));
+  sock_fprog prog{static_cast<unsigned short>(code.size()), code.data()};
+
+  if (setsockopt(e131_socket, SOL_SOCKET, SO_ATTACH_FILTER, &prog,
+                 sizeof(prog)) == -1)
+    throw std::system_error{errno, std::system_category()};
+
+  if (artnet_socket == -1) return;
+
+  /* ArtDmx fields are little-endian, while filters load big-endian words */
+  constexpr std::uint32_t opcode_offset{8};
+  constexpr std::uint32_t port_address_offset{14};
+  const std::uint32_t port_address{
+      static_cast<std::uint32_t>(universe_num - 1) & 0x7fff};
+
+  std::array<sock_filter, 7> artnet_code{{
+      BPF_STMT(BPF_LD | BPF_H | BPF_ABS, udp_header_size + opcode_offset),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x0050, 0, 4),
+      BPF_STMT(BPF_LD | BPF_H | BPF_ABS,
+               udp_header_size + port_address_offset),
+      BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xff7f),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+               ((port_address & 0xff) << 8) | (port_address >> 8), 0, 1),
+      BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+      BPF_STMT(BPF_RET | BPF_K, 0),
+  }};
+  sock_fprog artnet_prog{static_cast<unsigned short>(artnet_code.size()),
+                         artnet_code.data()};
+
+  if (setsockopt(artnet_socket, SOL_SOCKET, SO_ATTACH_FILTER, &artnet_prog,
+                 sizeof(artnet_prog)) == -1)
+    throw std::system_error{errno, std::system_category()};
+}
 
-  return false;
+bool
+universe::valid_packet(const packet_view& pkt) const noexcept
+{
+  return pkt.valid() && (pkt.universe() == uni) &&
+         (!pkt.preview() || ignore_preview_flag);
 }
 
 int
@@ -168,67 +297,224 @@ universe::timer_callback(sd_event_source* const s, std::uint64_t usec,
                          void* userdata) noexcept
 {
   auto& uni{*reinterpret_cast<universe* const>(userdata)};
-  auto& src{uni.srcs[uni.evs_cid.at(s)]};
 
-  try {
-    uni.remove_source(src);
-  } catch (const std::exception& e) {
-    sd_event_exit(uni.ev.get(), -1);
-    return -1;
+  for (auto i : uni.active_srcs) {
+    if (uni.srcs[i].timer_evs.get() == s) {
+      uni.remove_source(uni.srcs[i]);
+      break;
+    }
   }
   return 0;
 }
 
+std::uint64_t
+universe::arrival_time(msghdr& hdr, const clock_reading& clocks) noexcept
+{
+  timespec ts;
+
+  for (auto* cmsg{CMSG_FIRSTHDR(&hdr)}; cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+    if ((cmsg->cmsg_level == SOL_SOCKET) &&
+        (cmsg->cmsg_type == SCM_TIMESTAMPNS)) {
+      std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+      std::uint64_t stamp{(ts.tv_sec * UINT64_C(1000000)) +
+                          (ts.tv_nsec / 1000)};
+      /* A step of the realtime clock in between must not date the future */
+      std::uint64_t age{(clocks.realtime > stamp) ? (clocks.realtime - stamp)
+                                                  : 0};
+      return (clocks.monotonic > age) ? (clocks.monotonic - age) : 0;
+    }
+  }
+
+  return clocks.monotonic;
+}
+
+void
+universe::ingest(const cid& uuid, const dmx_frame& frame)
+{
+  auto* src{find_source(uuid)};
+
+  if (src) {
+    int sequence_delta{
+        static_cast<std::int8_t>(frame.sequence - src->sequence_data)};
+    /* Out-of-order packets, per E1.31 section 6.7.2 */
+    if (frame.sequenced && (sequence_delta <= 0) && (sequence_delta > -20)) {
+      E131_TRACE(arbitration, uni, trace::cid_hash(uuid.data()),
+                 frame.sequence, frame.prio, trace::rejected_sequence,
+                 frame.count);
+      return;
+    }
+    /* Data in packets with the terminated flag set is ignored */
+    if (frame.terminated) {
+      E131_TRACE(arbitration, uni, trace::cid_hash(uuid.data()),
+                 frame.sequence, frame.prio, trace::terminated, frame.count);
+      remove_source(*src);
+      return;
+    }
+    src->stats.record(frame.arrival, frame.sequenced ? sequence_delta : 1);
+    if (frame.prio != src->prio) {
+      prio.remove(src->prio);
+      prio.add(frame.prio);
+      src->prio                   = frame.prio;
+      src->stats.prio             = src->prio;
+      src->stats.priority_changed = frame.arrival;
+      if (merging == merge_mode::htp)
+        merge_engine.set_priority(src->slot, src->prio);
+    }
+  } else if (frame.terminated) {
+    return;
+  } else {
+    try {
+      src = &add_source(uuid, frame);
+    } catch (const source_limit_reached_event& e) {
+      queued_events.push_back(e);
+      return;
+    }
+  }
+
+  source_timer_reset(*src);
+
+  auto outcome{trace::rejected_priority};
+  if (merging == merge_mode::htp) {
+    merge_frame(*src, frame);
+    outcome = trace::merged;
+  } else if ((frame.prio >= prio) && (frame.start_code == null_start_code)) {
+    std::copy(frame.data, frame.data + frame.count, channel_data.data());
+    queued_events.push_back(channel_data_updated_event{uuid});
+    outcome = trace::applied;
+  }
+  E131_TRACE(arbitration, uni, trace::cid_hash(uuid.data()), frame.sequence,
+             frame.prio, outcome, frame.count);
+
+  src->sequence_data = frame.sequence;
+}
+
+void
+universe::process_packet(const std::uint8_t* pkt, std::size_t len,
+                         std::uint64_t arrival)
+{
+  packet_view view{pkt, len};
+  if (!valid_packet(view)) {
+    if (discovery && !view.valid()) process_discovery(pkt, len, arrival);
+    return;
+  }
+
+  ingest(make_cid(view.cid_data()),
+         dmx_frame{view.priority(), view.sequence(), true, view.terminated(),
+                   view.start_code(), view.data(), view.count(), arrival});
+}
+
+void
+universe::process_discovery(const std::uint8_t* pkt, std::size_t len,
+                            std::uint64_t arrival)
+{
+  discovery_view view{pkt, len};
+  if (!view.valid()) return;
+
+  /* Sources announce every discovery interval, and are dropped after two */
+  for (auto it{discovered.begin()}; it != discovered.end();) {
+    if ((arrival > it->second) &&
+        ((arrival - it->second) >
+         (2 * ms_to_us<std::uint64_t>(discovery_interval))))
+      it = discovered.erase(it);
+    else
+      ++it;
+  }
+
+  for (std::size_t i{0}; i < view.count(); i++) {
+    if (view.universe(i) == uni) {
+      discovered[make_cid(view.cid_data())] = arrival;
+      break;
+    }
+  }
+}
+
+void
+universe::process_artnet(const std::uint8_t* buf, std::size_t len,
+                         const sockaddr_storage& from, std::uint64_t arrival)
+{
+  /* ArtDmx packet layout, Art-Net 4 specification */
+  constexpr std::size_t header_size{18};
+  constexpr std::uint16_t opcode_dmx{0x5000};
+  constexpr std::uint16_t minimum_version{14};
+
+  if ((len < header_size) ||
+      !std::equal(artnet_id.begin(), artnet_id.end(), buf))
+    return;
+
+  std::uint16_t opcode(buf[8] | (buf[9] << 8));
+  std::uint16_t version((buf[10] << 8) | buf[11]);
+  std::uint16_t port_address(buf[14] | ((buf[15] & 0x7f) << 8));
+  std::size_t count((buf[16] << 8) | buf[17]);
+
+  if ((opcode != opcode_dmx) || (version < minimum_version) ||
+      (port_address != (uni - 1)) || (count > 512) ||
+      (count > (len - header_size)) || (from.ss_family != AF_INET))
+    return;
+
+  /* Art-Net has no CIDs, so sources are told apart by their addresses */
+  const auto& addr{reinterpret_cast<const sockaddr_in&>(from)};
+  cid uuid{};
+  auto* out{std::copy(artnet_id.begin(), artnet_id.end(), uuid.begin())};
+  out = std::copy_n(reinterpret_cast<const std::uint8_t*>(&addr.sin_addr),
+                    sizeof(addr.sin_addr), out);
+  std::copy_n(reinterpret_cast<const std::uint8_t*>(&addr.sin_port),
+              sizeof(addr.sin_port), out);
+
+  /* A sequence number of zero means that sequencing is disabled */
+  ingest(uuid, dmx_frame{artnet_priority, buf[12], buf[12] != 0, false,
+                         null_start_code, buf + header_size, count, arrival});
+}
+
+void
+universe::merge_frame(const source& src, const dmx_frame& frame) noexcept
+{
+  switch (frame.start_code) {
+  case null_start_code:
+    merge_engine.set_levels(src.slot, frame.data, frame.count);
+    break;
+  case priority_start_code:
+    merge_engine.set_channel_priorities(src.slot, frame.data, frame.count);
+    break;
+  default:
+    return;
+  }
+
+  merge_cid = src.uuid;
+}
+
 bool
-universe::socket_handler(std::uint32_t revents) noexcept
+universe::socket_handler(int fd, std::uint32_t revents) noexcept
 {
   try {
-    if (revents & EPOLLERR) throw std::runtime_error{"error on E1.31 socket"};
+    if (revents & EPOLLERR) throw std::runtime_error{"error on socket"};
     /* Other EPOLL events don't happen for UDP sockets */
     do {
-      e131_packet_t pkt;
-      ::ssize_t r{e131_recv(e131_socket, &pkt)};
+      for (auto& hdr : rx_headers) {
+        hdr.msg_hdr.msg_namelen    = sizeof(sockaddr_storage);
+        hdr.msg_hdr.msg_controllen = sizeof(rx_control);
+      }
+
+      int r{recvmmsg(fd, rx_headers.data(), rx_headers.size(), 0, nullptr)};
       if (r == -1) {
         if ((errno != EWOULDBLOCK) && (errno != EAGAIN))
           throw std::system_error{errno, std::system_category()};
         break;
       }
 
-      if (!valid_packet(pkt)) break;
-
-      cid uuid{pkt.root.cid, pkt.root.cid + sizeof(pkt.root.cid)};
-      bool terminated{e131_get_option(&pkt, E131_OPT_TERMINATED)};
-      bool registered_source{srcs.find(uuid) != srcs.end()};
-
-      if (registered_source) {
-        auto& src{srcs[uuid]};
-
-        if (e131_pkt_discard(&pkt, src.sequence_data)) break;
-        if (terminated) remove_source(src);
-        if (pkt.frame.priority != src.prio) {
-          prio.remove(src.prio);
-          prio.add(pkt.frame.priority);
-          src.prio = pkt.frame.priority;
-        }
-
-      } else if (terminated) {
-        break;
-      } else {
-        add_source(uuid, pkt);
-      }
-
-      auto& src{srcs[uuid]};
-      source_timer_reset(src);
-
-      if ((pkt.frame.priority >= prio) && pkt.dmp.prop_val_cnt &&
-          (pkt.dmp.prop_val[0] == 0x00)) {
-        std::copy(pkt.dmp.prop_val + 1,
-                  pkt.dmp.prop_val + be16toh(pkt.dmp.prop_val_cnt),
-                  channel_data.data());
-        queued_events.push_back(channel_data_updated_event{uuid});
+      received += r;
+      auto clocks{clock_reading::now()};
+      for (int i{0}; i < r; i++) {
+        auto arrival{arrival_time(rx_headers[i].msg_hdr, clocks)};
+        E131_TRACE(packet_received, uni, rx_headers[i].msg_len, arrival);
+        if (fd == e131_socket)
+          process_packet(rx_packets[i].data(), rx_headers[i].msg_len, arrival);
+        else
+          process_artnet(rx_packets[i].data(), rx_headers[i].msg_len,
+                         rx_addresses[i], arrival);
       }
 
-      src.sequence_data = pkt.frame.seq_number;
+      /* A short batch means that the socket has been drained */
+      if (static_cast<std::size_t>(r) < rx_headers.size()) break;
     } while (true);
   } catch (const std::exception& e) {
     return false;
@@ -243,39 +529,285 @@ universe::socket_callback(sd_event_source* s, int fd, std::uint32_t revents,
 {
   universe& uni{*reinterpret_cast<universe* const>(userdata)};
 
-  if (!uni.socket_handler(revents)) {
+  if (!uni.socket_handler(fd, revents)) {
     sd_event_exit(uni.ev.get(), -1);
     return -1;
   }
   return 0;
 }
 
-universe::universe(priority::count_type sources, bool preview_flag_ignore,
-                   int universe_num)
+universe::universe(no_socket_t, priority::count_type sources,
+                   bool preview_flag_ignore, int universe_num,
+                   merge_mode merge)
     : max_sources{sources}, ignore_preview_flag{preview_flag_ignore},
-      uni{universe_num}, e131_socket{::e131_socket()}
+      merging{merge}, merge_engine(std::max(sources, 0)), uni{universe_num}
 {
   int r;
   sd_event* evp;
 
-  if ((e131_socket == -1) ||
-      (::e131_bind(e131_socket, E131_DEFAULT_PORT) == -1))
+  if ((r = sd_event_new(&evp)) < 0)
+    throw std::system_error{-r, std::system_category()};
+
+  ev.reset(evp);
+  reserve_sources(sources);
+}
+
+universe::universe(priority::count_type sources, bool preview_flag_ignore,
+                   int universe_num, bool reuse_port, int receive_batch,
+                   merge_mode merge)
+    : universe(no_socket, sources, preview_flag_ignore, universe_num, merge)
+{
+  int r;
+  int enable{1};
+  int disable{0};
+
+  rx_packets.resize(std::max(receive_batch, 1));
+  rx_iovecs.resize(rx_packets.size());
+  rx_headers.resize(rx_packets.size());
+  rx_controls.resize(rx_packets.size());
+  rx_addresses.resize(rx_packets.size());
+  reserve_events();
+
+  e131_socket.reset(socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK, 0));
+  if ((e131_socket == -1) && (errno == EAFNOSUPPORT)) {
+    e131_socket.reset(socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0));
+    dual_stack = false;
+  }
+  if (e131_socket == -1) throw std::system_error{errno, std::system_category()};
+
+  /* IPv4 data arrives on the same socket, from v4-mapped addresses */
+  if (dual_stack && (setsockopt(e131_socket, IPPROTO_IPV6, IPV6_V6ONLY,
+                                &disable, sizeof(disable)) == -1))
     throw std::system_error{errno, std::system_category()};
 
-  int flags{fcntl(e131_socket, F_GETFL)};
-  if (flags == -1) throw std::system_error{errno, std::system_category()};
+  if (reuse_port && (setsockopt(e131_socket, SOL_SOCKET, SO_REUSEPORT,
+                                &enable, sizeof(enable)) == -1))
+    throw std::system_error{errno, std::system_category()};
 
-  if (fcntl(e131_socket, F_SETFL, flags | O_NONBLOCK))
+  if (setsockopt(e131_socket, SOL_SOCKET, SO_TIMESTAMPNS, &enable,
+                 sizeof(enable)) == -1)
     throw std::system_error{errno, std::system_category()};
 
-  if ((r = sd_event_new(&evp)) < 0)
-    throw std::system_error{-r, std::system_category()};
+  sockaddr_in addr{};
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htobe16(e131_port);
+  addr.sin_addr.s_addr = htobe32(INADDR_ANY);
+
+  sockaddr_in6 addr6{};
+  addr6.sin6_family = AF_INET6;
+  addr6.sin6_port   = htobe16(e131_port);
+  addr6.sin6_addr   = in6addr_any;
+
+  const auto* bind_addr{dual_stack ? reinterpret_cast<const sockaddr*>(&addr6)
+                                   : reinterpret_cast<const sockaddr*>(&addr)};
+  auto bind_len{
+      static_cast<socklen_t>(dual_stack ? sizeof(addr6) : sizeof(addr))};
+  if (bind(e131_socket, bind_addr, bind_len) == -1)
+    throw std::system_error{errno, std::system_category()};
 
-  ev.reset(evp);
+  set_membership(IP_ADD_MEMBERSHIP, uni);
+  attach_filter(uni);
+
+  for (std::size_t i{0}; i < rx_packets.size(); i++) {
+    rx_iovecs[i] = {rx_packets[i].data(), rx_packets[i].size()};
+    std::memset(&rx_headers[i], 0, sizeof(rx_headers[i]));
+    rx_headers[i].msg_hdr.msg_iov        = &rx_iovecs[i];
+    rx_headers[i].msg_hdr.msg_iovlen     = 1;
+    rx_headers[i].msg_hdr.msg_name       = &rx_addresses[i];
+    rx_headers[i].msg_hdr.msg_control    = rx_controls[i].buf;
+    rx_headers[i].msg_hdr.msg_controllen = sizeof(rx_controls[i]);
+  }
 
-  if ((r = sd_event_add_io(ev.get(), nullptr, e131_socket, EPOLLIN | EPOLLERR,
+  sd_event_source* evs;
+  if ((r = sd_event_add_io(ev.get(), &evs, e131_socket, EPOLLIN | EPOLLERR,
                            socket_callback, this)) < 0)
     throw std::system_error{-r, std::system_category()};
+  e131_evs.reset(evs);
+}
+
+void
+universe::set_universe(int universe_num)
+{
+  if (universe_num == uni) return;
+  if (e131_socket == -1) {
+    uni = universe_num;
+    remove_all_sources();
+    discovered.clear();
+    channel_data.fill(0);
+    return;
+  }
+
+  set_membership(IP_ADD_MEMBERSHIP, universe_num);
+  try {
+    attach_filter(universe_num);
+  } catch (const std::system_error& e) {
+    /* Restore the old filters, then leave the new groups */
+    try {
+      attach_filter(uni);
+      set_membership(IP_DROP_MEMBERSHIP, universe_num);
+    } catch (const std::system_error& rollback_error) {
+    }
+    throw;
+  }
+
+  /* Data for the old universe is already filtered out if this fails */
+  try {
+    set_membership(IP_DROP_MEMBERSHIP, uni);
+  } catch (const std::system_error& e) {
+  }
+
+  uni = universe_num;
+  remove_all_sources();
+  discovered.clear();
+  channel_data.fill(0);
+}
+
+void
+universe::reserve_sources(priority::count_type sources)
+{
+  std::size_t count(std::max(sources, 0));
+
+  /* The merge engine is sized in every mode, so that switching cannot fail */
+  merge_engine.grow(count);
+  if (count <= srcs.size()) return;
+
+  active_srcs.reserve(count);
+  vacant_srcs.reserve(count);
+  srcs.reserve(count);
+
+  /* Slots are added one at a time, each complete with its timer */
+  while (srcs.size() < count) {
+    int r;
+    sd_event_source* evs;
+    if ((r = sd_event_add_time(ev.get(), &evs, CLOCK_MONOTONIC, 0, 0,
+                               timer_callback, this)) < 0)
+      throw std::system_error{-r, std::system_category()};
+
+    std::unique_ptr<sd_event_source, deleters::sd_event_source> timer{evs};
+    if ((r = sd_event_source_set_enabled(evs, SD_EVENT_OFF)) < 0)
+      throw std::system_error{-r, std::system_category()};
+
+    srcs.emplace_back().timer_evs = std::move(timer);
+    vacant_srcs.push_back(srcs.size() - 1);
+  }
+  reserve_events();
+}
+
+void
+universe::reserve_events()
+{
+  /* Up to a source added and removed per slot, and an update per packet */
+  auto events{(2 * srcs.size()) + (4 * rx_packets.size())};
+  queued_events.reserve(events);
+  returned_events.reserve(events);
+}
+
+void
+universe::set_max_sources(priority::count_type sources) noexcept
+{
+  max_sources = sources;
+}
+
+void
+universe::set_ignore_preview_flag(bool preview_flag_ignore) noexcept
+{
+  ignore_preview_flag = preview_flag_ignore;
+}
+
+void
+universe::set_merge_mode(merge_mode merge) noexcept
+{
+  if (merge == merging) return;
+
+  merging = merge;
+  merge_engine.clear();
+  /* Tracked sources never exceed a maximum the engine was sized for */
+  if (merging == merge_mode::htp)
+    for (auto i : active_srcs)
+      srcs[i].slot = merge_engine.acquire(srcs[i].prio);
+}
+
+void
+universe::enable_artnet(priority::priority_type prio)
+{
+  int r;
+  int enable{1};
+  sockaddr_in addr{};
+
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htobe16(artnet_port);
+  addr.sin_addr.s_addr = htobe32(INADDR_ANY);
+
+  artnet_socket.reset(socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0));
+  if ((artnet_socket == -1) ||
+      (setsockopt(artnet_socket, SOL_SOCKET, SO_REUSEADDR, &enable,
+                  sizeof(enable)) == -1) ||
+      (setsockopt(artnet_socket, SOL_SOCKET, SO_TIMESTAMPNS, &enable,
+                  sizeof(enable)) == -1) ||
+      (bind(artnet_socket, reinterpret_cast<const sockaddr*>(&addr),
+            sizeof(addr)) == -1))
+    throw std::system_error{errno, std::system_category()};
+
+  if ((r = sd_event_add_io(ev.get(), nullptr, artnet_socket,
+                           EPOLLIN | EPOLLERR, socket_callback, this)) < 0)
+    throw std::system_error{-r, std::system_category()};
+
+  artnet_priority = prio;
+  attach_filter(uni);
+}
+
+void
+universe::enable_discovery()
+{
+  if (discovery) return;
+
+  if (e131_socket != -1)
+    set_membership(IP_ADD_MEMBERSHIP, discovery_universe);
+  discovery = true;
+  if (e131_socket != -1) attach_filter(uni);
+}
+
+void
+universe::enable_busy_poll(int usec, bool prefer)
+{
+  const std::array<int, 2> fds{e131_socket, artnet_socket};
+
+  for (auto fd : fds) {
+    if (fd == -1) continue;
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) == -1)
+      throw std::system_error{errno, std::system_category()};
+    if (!prefer) continue;
+#ifdef SO_PREFER_BUSY_POLL
+    int enable{1};
+    if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &enable,
+                   sizeof(enable)) == -1)
+      throw std::system_error{errno, std::system_category()};
+#else
+    throw std::runtime_error{"preferred busy polling not supported"};
+#endif
+  }
+}
+
+bool
+universe::receive()
+{
+  auto before{received};
+
+  if (((e131_socket != -1) && !socket_handler(e131_socket, 0)) ||
+      ((artnet_socket != -1) && !socket_handler(artnet_socket, 0)))
+    throw std::runtime_error{"error receiving DMX data"};
+  return received != before;
+}
+
+int
+universe::detach_socket()
+{
+  int r;
+
+  if (e131_evs &&
+      ((r = sd_event_source_set_enabled(e131_evs.get(), SD_EVENT_OFF)) < 0))
+    throw std::system_error{-r, std::system_category()};
+  return e131_socket;
 }
 
 int
@@ -288,24 +820,34 @@ const std::vector<update_event>&
 universe::update()
 {
   int r;
-  queued_events.clear();
 
   while ((r = sd_event_run(ev.get(), 0)) > 0)
     ;
 
   if (r < 0) throw std::system_error{-r, std::system_category()};
-  return queued_events;
+  return flush();
 }
 
-const priority&
-universe::prio_tracker() const noexcept
+const std::vector<update_event>&
+universe::flush()
 {
-  return prio;
+  returned_events.clear();
+
+  /* Merge once for every batch of updates processed */
+  if ((merging == merge_mode::htp) && merge_engine.merge(channel_data))
+    queued_events.push_back(channel_data_updated_event{merge_cid});
+
+  returned_events.swap(queued_events);
+  return returned_events;
 }
 
-const universe::channel_data_type&
-universe::dmx_data() const noexcept
+std::map<cid, source_statistics>
+universe::source_stats() const
 {
-  return channel_data;
+  std::map<cid, source_statistics> stats;
+  for_each_source([&stats](const auto& uuid, const auto& src_stats) {
+    stats.emplace(uuid, src_stats);
+  });
+  return stats;
 }
 } // namespace e131_receiver
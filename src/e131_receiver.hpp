@@ -9,26 +9,34 @@
 #ifndef E131_RECEIVER_HPP_
 #define E131_RECEIVER_HPP_
 
+#include <algorithm>
 #include <array>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <deleters.hpp>
-#include <e131.h>
+#include <e131_merger.hpp>
+#include <e131_packet.hpp>
 #include <endian.h>
 #include <fcntl.h>
 #include <functional>
 #include <iostream>
 #include <iterator>
+#include <linux/filter.h>
 #include <map>
 #include <memory>
-#include <numeric>
-#include <queue>
+#include <netinet/in.h>
 #include <stdexcept>
 #include <string>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <systemd/sd-event.h>
 #include <systemd/sd-journal.h>
+#include <trace.hpp>
 #include <unistd.h>
+#include <vector>
 
 /**
  * Functionality crucial to the E1.31 receiver implementation in e131_blinkt.
@@ -38,7 +46,21 @@ namespace e131_receiver
 /**
  * Type used to represent the 128 bit UUID of the source. Big Endian.
  */
-using cid = std::basic_string<std::uint8_t>;
+using cid = std::array<std::uint8_t, 16>;
+
+/**
+ * Obtain a source UUID from the bytes it is carried in.
+ *
+ * \param data start of the 16 bytes of the UUID.
+ * \return source UUID.
+ */
+inline cid
+make_cid(const std::uint8_t* data) noexcept
+{
+  cid uuid;
+  std::copy_n(data, uuid.size(), uuid.begin());
+  return uuid;
+}
 
 /**
  * E1.31 Network data loss timeout, in milliseconds.
@@ -46,9 +68,23 @@ using cid = std::basic_string<std::uint8_t>;
 constexpr std::uint32_t network_data_loss_timeout{2500};
 
 /**
- * E1.31 Root Layer Protocol Vector representing a payload of E1.31 data.
+ * E1.31 default source priority.
+ */
+constexpr std::uint8_t default_priority{100};
+
+/**
+ * UDP port on which Art-Net packets are received.
  */
-constexpr std::uint32_t e131_data_vector{0x00000004};
+constexpr std::uint16_t artnet_port{6454};
+
+/**
+ * Art-Net packet identifier.
+ *
+ * Also used as the prefix of the CIDs assigned to Art-Net sources, followed
+ * by the IPv4 address and UDP port of the source.
+ */
+constexpr std::array<std::uint8_t, 8> artnet_id{'A', 'r', 't', '-',
+                                                'N', 'e', 't', 0x00};
 
 /**
  * Convenience function to convert a time value in milliseconds to a
@@ -66,6 +102,24 @@ constexpr output_type ms_to_us(input_type ms) noexcept {
   return static_cast<output_type>(ms) * 1000;
 }
 
+/**
+ * String representation of a source UUID, held without allocating memory.
+ */
+struct cid_string {
+  std::array<char, 35> chars; ///< Null-terminated representation
+
+  /**
+   * Obtain the representation as a C string.
+   *
+   * \return null-terminated string, valid for the lifetime of the object.
+   */
+  const char*
+  c_str() const noexcept
+  {
+    return chars.data();
+  }
+};
+
 /**
  * Obtain the string representation of a source UUID
  *
@@ -74,8 +128,8 @@ constexpr output_type ms_to_us(input_type ms) noexcept {
  * where \code <val> contains the zero-padded hexadecimal representation of
  * the UUID, starting with the most-significant byte.
  */
-std::string
-cid_str(const cid& uuid);
+cid_string
+cid_str(const cid& uuid) noexcept;
 
 /**
  * Simple class akin to \ref std::unique_ptr, but for file descriptors, and with
@@ -116,6 +170,15 @@ public:
     return fd;
   }
 
+  /**
+   * Replace the file descriptor stored in the object, closing the previous
+   * one.
+   *
+   * \param f file descriptor to use.
+   */
+  void
+  reset(int f) noexcept;
+
   /**
    * Closes the file descriptor.
    */
@@ -143,13 +206,15 @@ public:
   static constexpr uint8_t minimum_priority{0};
 
 private:
-  std::map<priority_type, count_type> prio_cnt{};
+  std::array<count_type, 256> prio_cnt{}; ///< Sources at each priority
+  priority_type top{minimum_priority};    ///< Highest priority of a source
+  count_type total{0};                    ///< Sources at any priority
 
 public:
   /**
-   * Sets priority to the default E1.31 priority and source count to zero.
+   * Sets priority to the minimum E1.31 priority and source count to zero.
    */
-  priority();
+  priority() = default;
   /* Allow default move constructor */
   /* Allow default copy constructor */
   /* Allow default copy-assign */
@@ -161,7 +226,10 @@ public:
    * Allows users to obtain tracked priority level by using this object
    * in a context where a numeric type is required.
    */
-  operator priority_type() const noexcept;
+  operator priority_type() const noexcept
+  {
+    return top;
+  }
 
   /**
    * Add a new source priority.
@@ -170,7 +238,7 @@ public:
    * \return new priority level
    */
   priority_type
-  add(priority_type p);
+  add(priority_type p) noexcept;
 
   /**
    * Remove a source priority.
@@ -179,7 +247,7 @@ public:
    * \return new priority level.
    */
   priority_type
-  remove(priority_type p);
+  remove(priority_type p) noexcept;
 
   /**
    * Obtain the number of sources with priority equivalent to the
@@ -188,7 +256,10 @@ public:
    * \return source count.
    */
   count_type
-  sources() const noexcept;
+  sources() const noexcept
+  {
+    return prio_cnt[top];
+  }
 
   /**
    * Obtain the total number of sources tracked.
@@ -199,18 +270,137 @@ public:
   total_sources() const noexcept;
 };
 
+/**
+ * Simultaneous readings of the realtime and monotonic clocks.
+ *
+ * Kernel receive timestamps are taken from \c CLOCK_REALTIME, which steps
+ * when the system time is set. A reading taken after receiving a packet
+ * converts its timestamp to \c CLOCK_MONOTONIC, through the age of the
+ * packet.
+ */
+struct clock_reading {
+  std::uint64_t realtime;  ///< \c CLOCK_REALTIME, in microseconds
+  std::uint64_t monotonic; ///< \c CLOCK_MONOTONIC, in microseconds
+
+  /**
+   * Read both clocks.
+   *
+   * \return current clock readings.
+   */
+  static clock_reading
+  now() noexcept;
+};
+
+/**
+ * Running statistics kept for a particular source of E1.31 DMX data.
+ *
+ * Timestamps are arrival times, in microseconds of \c CLOCK_MONOTONIC.
+ */
+struct source_statistics {
+  /**
+   * Weight given to a new sample in the running averages, as a shift.
+   */
+  static constexpr unsigned int ewma_shift{4};
+
+  priority::priority_type prio{};     ///< Current source priority
+  std::uint64_t packets{0};           ///< Accepted packets
+  std::uint64_t sequence_gaps{0};     ///< Packets missing from the sequence
+  std::uint64_t last_arrival{0};      ///< Arrival time of the last packet
+  std::uint64_t priority_changed{0};  ///< Time of the last priority change
+  double interval{0};                 ///< Mean inter-arrival time, in us
+  double jitter{0};                   ///< Mean inter-arrival deviation, in us
+
+  /**
+   * Account for a packet accepted from the source.
+   *
+   * \param arrival arrival time of the packet.
+   * \param sequence_delta difference between the sequence number of the
+   *        packet and that of the previously accepted packet.
+   */
+  void
+  record(std::uint64_t arrival, int sequence_delta) noexcept
+  {
+    /* Arrivals before the last one are not usable as intervals */
+    if (packets++ && (arrival >= last_arrival)) {
+      double sample{static_cast<double>(arrival - last_arrival)};
+      double deviation{(sample > interval) ? (sample - interval)
+                                           : (interval - sample)};
+      interval += (sample - interval) / (1 << ewma_shift);
+      jitter += (deviation - jitter) / (1 << ewma_shift);
+    }
+    if (sequence_delta > 1) sequence_gaps += sequence_delta - 1;
+    last_arrival = std::max(last_arrival, arrival);
+  }
+
+  /**
+   * Obtain the packet rate of the source.
+   *
+   * \return packet rate, in packets per second.
+   */
+  double
+  rate() const noexcept
+  {
+    return (interval > 0) ? (1000000 / interval) : 0;
+  }
+};
+
+/**
+ * Operator overload to dump source statistics to an output stream, in a
+ * human-readable form.
+ *
+ * \param ost output stream to dump statistics to.
+ * \param stats statistics object.
+ * \return reference to the target output stream.
+ */
+std::ostream&
+operator<<(std::ostream& ost, const source_statistics& stats);
+
 /**
  * Structure representing information regarding a particular source of
  * E1.31 DMX data.
+ *
+ * Sources are kept in slots allocated up front, which are reused as
+ * sources come and go.
  */
 struct source {
-  const cid uuid;               ///< Source CID
-  priority::priority_type prio; ///< Priority at which the source broadcasts
-  std::uint8_t sequence_data;   ///< Sequence of the last E1.31 data packet
+  cid uuid{};                     ///< Source CID
+  priority::priority_type prio{}; ///< Priority at which the source broadcasts
+  std::uint8_t sequence_data{};   ///< Sequence of the last E1.31 data packet
   std::uint8_t
-      sequence_synchronization; ///< Sequence of the last E1.31 sync packet
+      sequence_synchronization{}; ///< Sequence of the last E1.31 sync packet
   std::unique_ptr<sd_event_source, deleters::sd_event_source>
-      timer_evs; ///< Data loss timer event source
+      timer_evs{};                ///< Data loss timer, off while vacant
+  source_statistics stats{};      ///< Running statistics
+  merger::slot_type slot{};       ///< Merge slot, when merging with HTP
+};
+
+/**
+ * Tag selecting the \ref universe constructor that opens no socket.
+ */
+struct no_socket_t {
+  explicit no_socket_t() = default;
+};
+
+/**
+ * See \ref no_socket_t
+ */
+inline constexpr no_socket_t no_socket{};
+
+/**
+ * Protocol-independent description of a packet of DMX data received from a
+ * source.
+ *
+ * The data is not copied out of the receive buffer.
+ */
+struct dmx_frame {
+  priority::priority_type prio; ///< Priority at which the source broadcasts
+  std::uint8_t sequence;        ///< Sequence number of the packet
+  bool sequenced;               ///< Whether the sequence number is valid
+  bool terminated;              ///< Whether the source is terminating
+  std::uint8_t start_code;      ///< DMX start code
+  const std::uint8_t* data;     ///< DMX data following the start code
+  std::size_t count;            ///< Number of bytes of DMX data
+  std::uint64_t arrival;        ///< Arrival time of the packet
 };
 
 /**
@@ -255,6 +445,11 @@ struct source_limit_reached_event : public update_event {
  *
  * Used to track sources and their priorities to decide from which source to
  * update DMX channel data from.
+ *
+ * E1.31 data is received on a single dual-stack socket, that joins both the
+ * IPv4 and the IPv6 multicast groups of the universe, so that data from
+ * either family is processed by the same path. Hosts without IPv6 fall back
+ * to an IPv4 socket.
  */
 class universe
 {
@@ -262,29 +457,73 @@ public:
   using channel_data_type = std::array<std::uint8_t, 512>;
 
 private:
+  /**
+   * Ancillary data buffer holding the receive timestamp of a packet.
+   */
+  union rx_control {
+    cmsghdr header;
+    char buf[CMSG_SPACE(sizeof(timespec))];
+  };
+
   priority prio{};                                  ///< Universe priority
-  std::map<const cid, source> srcs{};               ///< CID to source mapping
-  std::map<sd_event_source* const, cid> evs_cid{};  ///< Event source to cid map
+  std::vector<source> srcs{};                       ///< Source slots
+  std::vector<std::size_t> active_srcs{};           ///< Slots in use
+  std::vector<std::size_t> vacant_srcs{};           ///< Slots available
   channel_data_type channel_data{};                 ///< DMX channel data
-  std::queue<cid> pending_removal{};                ///< Sources pending removal
   std::vector<update_event> queued_events{};        ///< Events pending return
+  std::vector<update_event> returned_events{};      ///< Events returned
   priority::count_type max_sources;                 ///< Maximum source count
   bool ignore_preview_flag;                         ///< Preview flag ignore
+  merge_mode merging;                               ///< Source merge policy
+  merger merge_engine;                              ///< HTP merge engine
+  cid merge_cid{};                                  ///< Last merged source
+  priority::priority_type artnet_priority{};        ///< Art-Net priority
+  bool discovery{false};                            ///< Discovery enabled
+  std::map<cid, std::uint64_t> discovered{};        ///< Announcing sources
   int uni;                                          ///< Watched universe number
   unique_fd e131_socket;                            ///< E1.31 socket fd
+  bool dual_stack{true};                            ///< E1.31 socket has IPv6
+  std::uint64_t received{0};                        ///< Packets received
+  unique_fd artnet_socket{};                        ///< Art-Net socket fd
   std::unique_ptr<sd_event, deleters::sd_event> ev; ///< Systemd event loop
+  std::vector<packet_buffer> rx_packets{};          ///< Receive buffers
+  std::vector<iovec> rx_iovecs{};                   ///< Receive buffer vectors
+  std::vector<mmsghdr> rx_headers{};                ///< Receive msg headers
+  std::vector<rx_control> rx_controls{};            ///< Receive timestamps
+  std::vector<sockaddr_storage> rx_addresses{};     ///< Sender addresses
+  std::unique_ptr<sd_event_source, deleters::sd_event_source>
+      e131_evs{}; ///< E1.31 socket I/O event source
+
+  /**
+   * Reserve room for the events returned by \ref update(), for every source
+   * slot and receive buffer.
+   *
+   * \throws std::bad_alloc on failure to allocate memory.
+   */
+  void
+  reserve_events();
+
+  /**
+   * Find a tracked source.
+   *
+   * \param uuid UUID of the source.
+   * \return source object, or \c nullptr if the source is not tracked.
+   */
+  source*
+  find_source(const cid& uuid) noexcept;
 
   /**
    * Add and track a particular source sending E1.31 data for the watched
-   * universe.
+   * universe, in a vacant slot.
    *
    * \param uuid UUID of the source to be added.
-   * \param pkt initial E1.31 data packet from the source.
+   * \param frame initial DMX data packet from the source.
+   * \return newly added source object.
    * \throw source_limit_reached_event on reaching maximum source count.
    * \throw std::system_error on system-related errors on adding source.
    */
-  void
-  add_source(const cid& uuid, const e131_packet_t& pkt);
+  source&
+  add_source(const cid& uuid, const dmx_frame& frame);
 
   /**
    * Reset the network data loss timer for a particular source.
@@ -298,12 +537,49 @@ private:
   /**
    * Untrack a particular source.
    *
-   * The removal event will be pushed into \ref queued_events.
+   * The removal event will be pushed into \ref queued_events, and the slot
+   * of the source becomes vacant.
    *
    * \param src source object.
    */
   void
-  remove_source(const source& src);
+  remove_source(source& src) noexcept;
+
+  /**
+   * Untrack all sources.
+   *
+   * The removal events will be pushed into \ref queued_events.
+   */
+  void
+  remove_all_sources() noexcept;
+
+  /**
+   * Join or leave the IPv4 and IPv6 multicast groups of a universe.
+   *
+   * Only one of the two families needs to succeed, so that hosts with
+   * either family alone are served.
+   *
+   * \param optname \code IP_ADD_MEMBERSHIP to join the groups,
+   *        \code IP_DROP_MEMBERSHIP to leave the groups.
+   * \param universe_num universe number.
+   * \throw std::system_error on failure to change the membership of both
+   *        groups.
+   */
+  void
+  set_membership(int optname, std::uint16_t universe_num);
+
+  /**
+   * Attach socket filters to the E1.31 socket, and to the Art-Net socket
+   * if open, that only accept datagrams addressed to a universe.
+   *
+   * Foreign traffic is then dropped by the kernel, and never wakes the
+   * event loop.
+   *
+   * \param universe_num universe number.
+   * \throw std::system_error on failure to attach the filter.
+   */
+  void
+  attach_filter(int universe_num);
 
   /**
    * Checks if an E1.31 packet is valid, and should be processed further.
@@ -322,8 +598,63 @@ private:
    * \retval true packet should be processed further.
    * \retval false packet processing should terminate.
    */
-  auto
-  valid_packet(const e131_packet_t& pkt) const;
+  bool
+  valid_packet(const packet_view& pkt) const noexcept;
+
+  /**
+   * Arbitrate a packet of DMX data received from a source, regardless of
+   * the protocol it was received with.
+   *
+   * Out-of-sequence and rejected packets are skipped.
+   *
+   * \param uuid UUID of the source.
+   * \param frame received DMX data.
+   * \throw std::system_error on system-related errors.
+   */
+  void
+  ingest(const cid& uuid, const dmx_frame& frame);
+
+  /**
+   * Process a single received E1.31 universe discovery packet.
+   *
+   * Sources that list the watched universe are remembered until they stop
+   * announcing it.
+   *
+   * \param pkt received packet.
+   * \param len number of bytes received into the packet.
+   * \param arrival arrival time of the packet.
+   */
+  void
+  process_discovery(const std::uint8_t* pkt, std::size_t len,
+                    std::uint64_t arrival);
+
+  /**
+   * Process a single received Art-Net packet.
+   *
+   * Only ArtDmx packets addressed to the Art-Net port-address one below the
+   * watched universe number are processed, with sources identified by their
+   * address.
+   *
+   * \param buf received packet.
+   * \param len number of bytes received into the packet.
+   * \param from address of the sender.
+   * \param arrival arrival time of the packet.
+   * \throw std::system_error on system-related errors.
+   */
+  void
+  process_artnet(const std::uint8_t* buf, std::size_t len,
+                 const sockaddr_storage& from, std::uint64_t arrival);
+
+  /**
+   * Pass the DMX data in a packet to the HTP merge engine.
+   *
+   * Handles both DMX level data and per-channel priority packets.
+   *
+   * \param src source the packet was received from.
+   * \param frame received DMX data.
+   */
+  void
+  merge_frame(const source& src, const dmx_frame& frame) noexcept;
 
   /**
    * Callback to be called by the event loop on timer expiring.
@@ -338,18 +669,19 @@ private:
                  void* userdata) noexcept;
 
   /**
-   * Handle updates from the E1.31 socket.
+   * Handle updates from the E1.31 or Art-Net socket.
    *
+   * \param fd socket with pending updates.
    * \param revents events bitmask from the I/O event callback.
    * \retval true successfully processed updates
    * \retval false unsuccessfully processed updates.
    */
   bool
-  socket_handler(std::uint32_t revents) noexcept;
+  socket_handler(int fd, std::uint32_t revents) noexcept;
 
   /**
    * Callback to be called by the event loop when data has been received
-   * on the E1.31 socket.
+   * on the E1.31 or Art-Net socket.
    *
    * \see sd_event_add_io for more information regarding
    *      function arguments.
@@ -369,10 +701,37 @@ public:
    *        E1.31 data packets.
    * \param universe_num the universe number assigned to the universe this
    *        object is tracking.
+   * \param reuse_port whether to share the E1.31 port with other receivers
+   *        through \code SO_REUSEPORT.
+   * \param receive_batch maximum number of packets to dequeue from the
+   *        E1.31 socket in a single system call.
+   * \param merge policy used to combine data from sources at the same
+   *        priority.
    * \throws std::system_error on system failures.
    */
   universe(priority::count_type sources, bool preview_flag_ignore,
-           int universe_num);
+           int universe_num, bool reuse_port = false, int receive_batch = 16,
+           merge_mode merge = merge_mode::ltp);
+
+  /**
+   * Initialize a universe object that opens no socket, and only processes
+   * packets passed to \ref process_packet().
+   *
+   * Used to run the processing core in isolation, such as under a fuzzer
+   * or in benchmarks. Multicast group changes are skipped, and there is
+   * nothing to receive.
+   *
+   * \param sources maximum number of sources to register.
+   * \param preview_flag_ignore whether to ignore the preview flag in
+   *        E1.31 data packets.
+   * \param universe_num the universe number assigned to the universe this
+   *        object is tracking.
+   * \param merge policy used to combine data from sources at the same
+   *        priority.
+   * \throws std::system_error on system failures.
+   */
+  universe(no_socket_t, priority::count_type sources, bool preview_flag_ignore,
+           int universe_num, merge_mode merge = merge_mode::ltp);
   universe(const universe& other)  = delete;
   universe(const universe&& other) = delete;
   universe&
@@ -380,6 +739,142 @@ public:
   universe&
   operator=(const universe&& other) = delete;
 
+  /**
+   * Change the universe number of the universe this object is tracking.
+   *
+   * The multicast groups of the new universe are joined, and the socket
+   * filters replaced, before the old groups are left. On failure, the
+   * universe is left tracking the old universe number.
+   *
+   * All tracked sources are removed, and the DMX data of the old universe
+   * cleared. Removal events are returned by the next call to \ref update()
+   * or \ref flush(), as no source timer is left to wake the event loop.
+   *
+   * \param universe_num new universe number.
+   * \throws std::system_error on system failures.
+   */
+  void
+  set_universe(int universe_num);
+
+  /**
+   * Allocate the state needed to track a number of sources, so that
+   * \ref set_max_sources() and \ref set_merge_mode() cannot fail, and so
+   * that sources are tracked without allocating memory.
+   *
+   * The allocated state is kept even if the maximum is never raised.
+   *
+   * \param sources maximum number of sources to register.
+   * \throws std::bad_alloc on failure to allocate memory.
+   * \throws std::system_error on failure to create source timers.
+   */
+  void
+  reserve_sources(priority::count_type sources);
+
+  /**
+   * Change the maximum number of sources to register.
+   *
+   * Sources already registered beyond the new maximum are kept until they
+   * are removed.
+   *
+   * \param sources maximum number of sources to register.
+   * \pre \ref reserve_sources() was called with at least \p sources.
+   */
+  void
+  set_max_sources(priority::count_type sources) noexcept;
+
+  /**
+   * Change whether to ignore the preview flag in E1.31 data packets.
+   *
+   * \param preview_flag_ignore whether to ignore the preview flag.
+   */
+  void
+  set_ignore_preview_flag(bool preview_flag_ignore) noexcept;
+
+  /**
+   * Change the policy used to combine data from sources at the same
+   * priority.
+   *
+   * When switching to HTP, sources contribute to the merge from the next
+   * packet they send.
+   *
+   * \param merge merge policy.
+   */
+  void
+  set_merge_mode(merge_mode merge) noexcept;
+
+  /**
+   * Additionally accept DMX data sent with Art-Net.
+   *
+   * Art-Net sources are arbitrated together with E1.31 sources.
+   *
+   * \param prio priority assigned to Art-Net sources.
+   * \throws std::system_error on system failures.
+   */
+  void
+  enable_artnet(priority::priority_type prio);
+
+  /**
+   * Additionally accept E1.31 universe discovery packets, to learn of
+   * sources announcing the watched universe before they send data to it.
+   *
+   * \throws std::system_error on system failures.
+   */
+  void
+  enable_discovery();
+
+  /**
+   * Obtain the sources announcing the watched universe through universe
+   * discovery.
+   *
+   * \return mapping from source CID to the arrival time of its last
+   *         announcement.
+   */
+  const std::map<cid, std::uint64_t>&
+  discovered_sources() const noexcept
+  {
+    return discovered;
+  }
+
+  /**
+   * Busy poll the device queues of the E1.31 and Art-Net sockets for up to
+   * the given time when receiving, instead of waiting for interrupts.
+   *
+   * \param usec busy polling time, in microseconds. Raising it above the
+   *        \c net.core.busy_read sysctl requires \c CAP_NET_ADMIN.
+   * \param prefer whether to prefer busy polling over interrupt-driven
+   *        processing, through \code SO_PREFER_BUSY_POLL.
+   * \throws std::system_error on system failures.
+   * \throws std::runtime_error if preferred busy polling is not supported.
+   */
+  void
+  enable_busy_poll(int usec, bool prefer);
+
+  /**
+   * Receive data on the E1.31 and Art-Net sockets without waiting for the
+   * event loop to signal it, so that the receive path can be spun on.
+   *
+   * Updates are returned by the next call to \ref update().
+   *
+   * \retval true packets were received.
+   * \retval false no packet was pending.
+   * \throws std::runtime_error on error while receiving.
+   */
+  bool
+  receive();
+
+  /**
+   * Stop receiving on the E1.31 socket, so that packets are received from
+   * it elsewhere and passed to \ref process_packet().
+   *
+   * The socket stays owned by this object, and keeps following changes of
+   * the watched universe. The Art-Net socket is still received on.
+   *
+   * \return E1.31 socket fd, or -1 if this object opened no socket.
+   * \throws std::system_error on system failures.
+   */
+  int
+  detach_socket();
+
   /**
    * Obtain a file descriptor that can be polled for \code POLLIN or
    * \code EPOLLIN events, to signal when to call the \ref update()
@@ -391,6 +886,39 @@ public:
   int
   event_fd() const noexcept;
 
+  /**
+   * Process a single E1.31 packet, as if it had been received on the E1.31
+   * socket.
+   *
+   * Invalid, out-of-sequence and rejected packets are skipped, and do not
+   * affect the processing of packets received after them. Allows packets
+   * to be fed from sources other than the network, such as captures.
+   * Resulting events are returned by the next call to \ref update().
+   *
+   * \param pkt received packet, which may be malformed or truncated.
+   * \param len number of bytes in the packet.
+   * \param arrival arrival time of the packet, in microseconds of
+   *        \c CLOCK_MONOTONIC.
+   * \throw std::system_error on system-related errors.
+   */
+  void
+  process_packet(const std::uint8_t* pkt, std::size_t len,
+                 std::uint64_t arrival);
+
+  /**
+   * Obtain the arrival time of a received packet on the monotonic clock.
+   *
+   * Usable with any socket that has \c SO_TIMESTAMPNS enabled.
+   *
+   * \param hdr message header the packet was received with.
+   * \param clocks clock readings taken after the packet was received.
+   * \return kernel receive timestamp of the packet, or the time of the
+   *         readings if the kernel did not provide one, in microseconds of
+   *         \c CLOCK_MONOTONIC.
+   */
+  static std::uint64_t
+  arrival_time(msghdr& hdr, const clock_reading& clocks) noexcept;
+
   /**
    * Process data for the universe tracker.
    *
@@ -405,17 +933,68 @@ public:
    * \note When any exception has occurred, the E1.31 receiver is considered
    *       to be in a degraded state. No non-const operations may then be
    *       performed on the receiver object.
+   * \note Events caused by calls to other member functions since the last
+   *       call are returned as well.
    */
   const std::vector<update_event>&
   update();
 
+  /**
+   * Obtain the events caused by calls to other member functions since the
+   * last call, without running the event loop of this object.
+   *
+   * For receivers that pass packets to \ref process_packet() themselves,
+   * and call \ref update() only when the file descriptor associated with
+   * \ref event_fd() can be read from. Timers of sources added since are
+   * only armed by the next call to \ref update().
+   *
+   * \return vector of \ref update_event objects.
+   */
+  const std::vector<update_event>&
+  flush();
+
+  /**
+   * Obtain the universe number of the universe this object is tracking.
+   *
+   * \return universe number.
+   */
+  int
+  universe_number() const noexcept
+  {
+    return uni;
+  }
+
   /**
    * Access the priority tracker used by this universe object.
    *
    * \return priority tracker object used.
    */
   const priority&
-  prio_tracker() const noexcept;
+  prio_tracker() const noexcept
+  {
+    return prio;
+  }
+
+  /**
+   * Obtain the running statistics of every tracked source.
+   *
+   * \return mapping from source CID to source statistics.
+   */
+  std::map<cid, source_statistics>
+  source_stats() const;
+
+  /**
+   * Call a function with the CID and running statistics of every tracked
+   * source, without copying them.
+   *
+   * \param f function called as \code f(uuid, stats).
+   */
+  template<typename F>
+  void
+  for_each_source(F&& f) const
+  {
+    for (auto i : active_srcs) f(srcs[i].uuid, srcs[i].stats);
+  }
 
   /**
    * Obtain the DMX channel data, updated from the most recent
@@ -424,7 +1003,10 @@ public:
    * \return DMX channel data represented as an array of 512 bytes.
    */
   const channel_data_type&
-  dmx_data() const noexcept;
+  dmx_data() const noexcept
+  {
+    return channel_data;
+  }
 };
 } // namespace e131_receiver
 
@@ -0,0 +1,310 @@
+/**
+ * \file e131_relay.cpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <e131_relay.hpp>
+
+namespace e131_relay
+{
+
+/* Packet layout, ANSI E1.31-2016 section 4 */
+constexpr std::size_t cid_offset{22};
+constexpr std::size_t source_name_offset{44};
+constexpr std::size_t priority_offset{108};
+constexpr std::size_t sequence_offset{111};
+constexpr std::size_t options_offset{112};
+constexpr std::size_t universe_offset{113};
+constexpr std::size_t data_offset{126};
+constexpr std::uint8_t option_terminated{0x40};
+
+/**
+ * Header of a packet carrying a full universe, with the CID, source name,
+ * priority, sequence number, options and universe number left blank.
+ */
+constexpr std::array<std::uint8_t, data_offset> header_template{[]() {
+  std::array<std::uint8_t, data_offset> h{};
+  constexpr std::array<std::uint8_t, 16> preamble{
+      0x00, 0x10, 0x00, 0x00, 'A', 'S', 'C', '-',
+      'E',  '1',  '.',  '1',  '7', 0x00, 0x00, 0x00};
+  constexpr std::size_t packet_size{data_offset + 512};
+  auto put16{[&h](std::size_t offset, std::uint16_t v) {
+    h[offset]     = static_cast<std::uint8_t>(v >> 8);
+    h[offset + 1] = static_cast<std::uint8_t>(v);
+  }};
+
+  for (std::size_t i{0}; i < preamble.size(); i++) h[i] = preamble[i];
+  /* Flags and length of each layer, then its vector */
+  put16(16, 0x7000 | (packet_size - 16));
+  h[21] = 0x04;
+  put16(38, 0x7000 | (packet_size - 38));
+  h[43] = 0x02;
+  put16(115, 0x7000 | (packet_size - 115));
+  h[117] = 0x02;
+  /* Address and data type, address increment, property value count */
+  h[118] = 0xa1;
+  put16(121, 0x0001);
+  put16(123, 513);
+  return h;
+}()};
+
+/**
+ * Application ID from which the relay CID is derived, so that it is stable
+ * across restarts but unique to each machine.
+ */
+constexpr sd_id128_t cid_app_id{{0x5c, 0x1e, 0x8a, 0x3f, 0x6d, 0x27, 0x4b,
+                                 0x90, 0xa4, 0x13, 0xe2, 0x58, 0x0b, 0x7c,
+                                 0xd1, 0x96}};
+
+constexpr char source_name[]{"e131_blinkt relay"};
+
+static_assert(sizeof(source_name) <= 64, "E1.31 source name too long");
+
+/**
+ * Fill in the CID and source name of a packet.
+ *
+ * \param packet start of the packet.
+ * \throws std::system_error on failure to derive the CID.
+ */
+static void
+set_identity(std::uint8_t* packet)
+{
+  int r;
+  sd_id128_t id;
+
+  if ((r = sd_id128_get_machine_app_specific(cid_app_id, &id)) < 0)
+    throw std::system_error{-r, std::system_category()};
+
+  std::copy(std::begin(id.bytes), std::end(id.bytes), packet + cid_offset);
+  std::copy(std::begin(source_name), std::end(source_name),
+            packet + source_name_offset);
+}
+
+void
+relay::flush()
+{
+  std::uint64_t now;
+  std::uint64_t next{UINT64_MAX};
+  std::size_t due{0};
+  int r;
+
+  if ((r = sd_event_now(sd_event_source_get_event(timer.get()),
+                        CLOCK_MONOTONIC, &now)) < 0)
+    throw std::system_error{-r, std::system_category()};
+
+  for (std::size_t i{0}; i < destinations.size(); i++) {
+    const auto& dest{destinations[i]};
+    if ((dest.pending && (now >= (dest.last_sent + min_interval))) ||
+        (now >= (dest.last_sent + keepalive_interval))) {
+      headers[due].msg_hdr.msg_name = &destinations[i].addr;
+      batch[due++]                  = i;
+    }
+  }
+
+  if (due) {
+    packet[sequence_offset] = sequence++;
+    r = sendmmsg(relay_socket, headers.data(), due, 0);
+    if ((r == -1) && (errno != EAGAIN) && (errno != EWOULDBLOCK) &&
+        (errno != ENOBUFS))
+      throw std::system_error{errno, std::system_category()};
+
+    /* Destinations not sent to stay pending, and are retried */
+    for (int i{0}; i < r; i++) {
+      destinations[batch[i]].last_sent = now;
+      destinations[batch[i]].pending   = false;
+    }
+  }
+
+  for (const auto& dest : destinations) {
+    auto interval{dest.pending ? min_interval : keepalive_interval};
+    next = std::min(next, dest.last_sent + interval);
+  }
+
+  next = std::max(next, now);
+  if (((r = sd_event_source_set_time(timer.get(), next)) < 0) ||
+      ((r = sd_event_source_set_enabled(timer.get(), SD_EVENT_ONESHOT)) < 0))
+    throw std::system_error{-r, std::system_category()};
+}
+
+void
+relay::send_all() noexcept
+{
+  for (std::size_t i{0}; i < destinations.size(); i++)
+    headers[i].msg_hdr.msg_name = &destinations[i].addr;
+  packet[sequence_offset] = sequence++;
+  static_cast<void>(
+      sendmmsg(relay_socket, headers.data(), destinations.size(), 0));
+}
+
+int
+relay::timer_callback(sd_event_source* s, std::uint64_t usec,
+                      void* userdata) noexcept
+{
+  auto& rel{*reinterpret_cast<relay*>(userdata)};
+
+  try {
+    rel.flush();
+  } catch (const std::exception& e) {
+    sd_journal_print(LOG_ERR, "Unable to relay E1.31 data: %s", e.what());
+  }
+
+  return 0;
+}
+
+relay::relay(sd_event* ev, int universe_num,
+             const std::vector<std::string>& hosts, int max_rate)
+    : headers(hosts.size()), batch(hosts.size()),
+      min_interval{(max_rate > 0) ? (UINT64_C(1000000) / max_rate) : 0},
+      relay_socket{socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)}
+{
+  int r;
+  sd_event_source* s;
+
+  if (max_rate <= 0) throw std::runtime_error{"invalid relay rate"};
+  if (hosts.empty()) throw std::runtime_error{"no relay destinations"};
+
+  for (const auto& host : hosts) {
+    destination dest{};
+    dest.addr.sin_family = AF_INET;
+    dest.addr.sin_port   = htobe16(e131_receiver::e131_port);
+    if (inet_pton(AF_INET, host.c_str(), &dest.addr.sin_addr) != 1)
+      throw std::runtime_error{"invalid relay destination: " + host};
+    destinations.push_back(dest);
+  }
+
+  if (relay_socket == -1)
+    throw std::system_error{errno, std::system_category()};
+
+  std::copy(header_template.begin(), header_template.end(), packet.begin());
+  set_identity(packet.data());
+  set_universe(universe_num);
+
+  packet_iovec = {packet.data(), packet.size()};
+  for (auto& hdr : headers) {
+    hdr.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    hdr.msg_hdr.msg_iov     = &packet_iovec;
+    hdr.msg_hdr.msg_iovlen  = 1;
+  }
+
+  if ((r = sd_event_add_time(ev, &s, CLOCK_MONOTONIC, 0, 0, timer_callback,
+                             this)) < 0)
+    throw std::system_error{-r, std::system_category()};
+  timer.reset(s);
+
+  if ((r = sd_event_source_set_enabled(s, SD_EVENT_OFF)) < 0)
+    throw std::system_error{-r, std::system_category()};
+}
+
+void
+relay::set_universe(int universe_num) noexcept
+{
+  stop();
+  packet[universe_offset]     = static_cast<std::uint8_t>(universe_num >> 8);
+  packet[universe_offset + 1] = static_cast<std::uint8_t>(universe_num);
+}
+
+void
+relay::send(const e131_receiver::universe::channel_data_type& data,
+            std::uint8_t prio)
+{
+  std::copy(data.begin(), data.end(), packet.begin() + data_offset);
+  packet[priority_offset] = prio;
+  for (auto& dest : destinations) dest.pending = true;
+  active = true;
+  flush();
+}
+
+void
+relay::stop() noexcept
+{
+  if (!active) return;
+
+  /* Stream termination is signalled with three packets, section 6.2.6 */
+  packet[options_offset] = option_terminated;
+  for (int i{0}; i < 3; i++) send_all();
+  packet[options_offset] = 0;
+
+  for (auto& dest : destinations) dest = destination{dest.addr};
+  if (timer) sd_event_source_set_enabled(timer.get(), SD_EVENT_OFF);
+  active = false;
+}
+
+relay::~relay()
+{
+  stop();
+}
+
+int
+announcer::timer_callback(sd_event_source* s, std::uint64_t usec,
+                          void* userdata) noexcept
+{
+  auto& ann{*reinterpret_cast<announcer*>(userdata)};
+
+  /* Announcements are best-effort, and are retried on the next interval */
+  static_cast<void>(sendto(ann.announce_socket, ann.packet.data(),
+                           ann.packet.size(), 0,
+                           reinterpret_cast<const sockaddr*>(&ann.group),
+                           sizeof(ann.group)));
+
+  sd_event_source_set_time(
+      s, usec + e131_receiver::ms_to_us<std::uint64_t>(
+                    e131_receiver::discovery_interval));
+  return 0;
+}
+
+announcer::announcer(sd_event* ev, int universe_num)
+    : announce_socket{socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)}
+{
+  int r;
+  std::uint64_t now;
+  unsigned char loop{0};
+  sd_event_source* s;
+  auto put16{[this](std::size_t offset, std::uint16_t v) {
+    packet[offset]     = static_cast<std::uint8_t>(v >> 8);
+    packet[offset + 1] = static_cast<std::uint8_t>(v);
+  }};
+
+  if ((announce_socket == -1) ||
+      (setsockopt(announce_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop,
+                  sizeof(loop)) == -1))
+    throw std::system_error{errno, std::system_category()};
+
+  /* Packet layout, ANSI E1.31-2016 section 4.3 */
+  std::copy(e131_receiver::acn_preamble.begin(),
+            e131_receiver::acn_preamble.end(), packet.begin());
+  put16(16, 0x7000 | (packet.size() - 16));
+  packet[21] = e131_receiver::e131_extended_vector;
+  put16(38, 0x7000 | (packet.size() - 38));
+  packet[43] = 0x02;
+  put16(112, 0x7000 | (packet.size() - 112));
+  packet[117] = 0x01;
+  set_identity(packet.data());
+  set_universe(universe_num);
+
+  group.sin_family      = AF_INET;
+  group.sin_port        = htobe16(e131_receiver::e131_port);
+  group.sin_addr.s_addr = htobe32(UINT32_C(0xefff0000) |
+                                  e131_receiver::discovery_universe);
+
+  if (((r = sd_event_now(ev, CLOCK_MONOTONIC, &now)) < 0) ||
+      ((r = sd_event_add_time(ev, &s, CLOCK_MONOTONIC, now,
+                              e131_receiver::ms_to_us<std::uint64_t>(1000),
+                              timer_callback, this)) < 0))
+    throw std::system_error{-r, std::system_category()};
+  timer.reset(s);
+
+  if (((r = sd_event_source_set_priority(s, SD_EVENT_PRIORITY_IDLE)) < 0) ||
+      ((r = sd_event_source_set_enabled(s, SD_EVENT_ON)) < 0))
+    throw std::system_error{-r, std::system_category()};
+}
+
+void
+announcer::set_universe(int universe_num) noexcept
+{
+  packet[120] = static_cast<std::uint8_t>(universe_num >> 8);
+  packet[121] = static_cast<std::uint8_t>(universe_num);
+}
+} // namespace e131_relay
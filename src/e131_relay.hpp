@@ -0,0 +1,212 @@
+/**
+ * \file e131_relay.hpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#ifndef E131_RELAY_HPP_
+#define E131_RELAY_HPP_
+
+#include <arpa/inet.h>
+#include <array>
+#include <cstdint>
+#include <deleters.hpp>
+#include <e131_packet.hpp>
+#include <e131_receiver.hpp>
+#include <memory>
+#include <string>
+#include <systemd/sd-event.h>
+#include <systemd/sd-id128.h>
+#include <vector>
+
+/**
+ * Emission of E1.31 packets: re-emission of arbitrated DMX data as unicast
+ * E1.31, and universe discovery announcements.
+ */
+namespace e131_relay
+{
+/**
+ * Longest interval between packets sent to a destination, in microseconds.
+ *
+ * Unchanged data is resent at this interval, so that receivers do not time
+ * the relay out.
+ */
+constexpr std::uint64_t keepalive_interval{1000000};
+
+/**
+ * Sends the DMX data of a universe to a list of unicast destinations.
+ *
+ * All packets are built in a single buffer from a template filled in on
+ * construction, and sent to all destinations that are due with one
+ * \c sendmmsg() call.
+ */
+class relay
+{
+private:
+  /**
+   * State of a single destination.
+   */
+  struct destination {
+    sockaddr_in addr;           ///< Destination address
+    std::uint64_t last_sent{0}; ///< Monotonic time of the last packet sent
+    bool pending{false};        ///< Whether data has changed since then
+  };
+
+  e131_receiver::packet_buffer packet{};  ///< Packet sent to destinations
+  std::vector<destination> destinations{}; ///< Unicast destinations
+  std::vector<mmsghdr> headers{};          ///< Send msg headers
+  std::vector<std::size_t> batch{};        ///< Destinations in a send call
+  iovec packet_iovec{};                    ///< Vector covering the packet
+  std::uint64_t min_interval;              ///< Shortest interval, us
+  std::uint8_t sequence{0};                ///< Sequence number of next packet
+  bool active{false};                      ///< Whether data is being sent
+  e131_receiver::unique_fd relay_socket;   ///< Relay socket fd
+  std::unique_ptr<sd_event_source, deleters::sd_event_source>
+      timer{}; ///< Rate limit and keepalive timer
+
+  /**
+   * Send the packet to all destinations that are due, and rearm the timer
+   * for the next destination to become due.
+   *
+   * \throws std::system_error on system failures.
+   */
+  void
+  flush();
+
+  /**
+   * Send the packet to every destination, regardless of rate limits.
+   */
+  void
+  send_all() noexcept;
+
+  /**
+   * Callback to be called by the event loop when a destination is due.
+   *
+   * \see sd_event_add_time for more information regarding
+   *      function arguments.
+   * \retval 0 callback execution success.
+   * \retval nonzero callback execution failure.
+   */
+  static int
+  timer_callback(sd_event_source* s, std::uint64_t usec,
+                 void* userdata) noexcept;
+
+public:
+  /**
+   * Start relaying a universe.
+   *
+   * \param ev event loop to run the relay timers on.
+   * \param universe_num universe number to send data with.
+   * \param hosts IPv4 addresses of the destinations.
+   * \param max_rate highest number of packets sent to a destination each
+   *        second.
+   * \throws std::runtime_error on invalid destination addresses or rates.
+   * \throws std::system_error on system failures.
+   */
+  relay(sd_event* ev, int universe_num, const std::vector<std::string>& hosts,
+        int max_rate);
+  relay(const relay& other)  = delete;
+  relay(const relay&& other) = delete;
+  relay&
+  operator=(const relay& other) = delete;
+  relay&
+  operator=(const relay&& other) = delete;
+
+  /**
+   * Change the universe number data is sent with.
+   *
+   * Destinations are told that the previous universe has terminated.
+   *
+   * \param universe_num new universe number.
+   */
+  void
+  set_universe(int universe_num) noexcept;
+
+  /**
+   * Relay DMX data.
+   *
+   * Destinations that received a packet too recently receive the data once
+   * their rate limit allows.
+   *
+   * \param data DMX channel data.
+   * \param prio priority to send the data with.
+   * \throws std::system_error on system failures.
+   */
+  void
+  send(const e131_receiver::universe::channel_data_type& data,
+       std::uint8_t prio);
+
+  /**
+   * Stop relaying, telling destinations that the stream has terminated.
+   *
+   * Relaying restarts on the next call to \ref send().
+   */
+  void
+  stop() noexcept;
+
+  /**
+   * Stops relaying.
+   */
+  ~relay();
+};
+
+/**
+ * Announces the watched universe on the E1.31 universe discovery multicast
+ * group, at the discovery interval.
+ *
+ * Announcements are sent from an idle-priority timer, so that they never
+ * delay the processing of DMX data.
+ */
+class announcer
+{
+private:
+  /**
+   * Universe discovery packet listing a single universe.
+   */
+  std::array<std::uint8_t, 122> packet{};
+  sockaddr_in group{};                      ///< Discovery multicast group
+  e131_receiver::unique_fd announce_socket; ///< Announcement socket fd
+  std::unique_ptr<sd_event_source, deleters::sd_event_source>
+      timer{}; ///< Announcement timer
+
+  /**
+   * Callback to be called by the event loop when an announcement is due.
+   *
+   * \see sd_event_add_time for more information regarding
+   *      function arguments.
+   * \retval 0 callback execution success.
+   * \retval nonzero callback execution failure.
+   */
+  static int
+  timer_callback(sd_event_source* s, std::uint64_t usec,
+                 void* userdata) noexcept;
+
+public:
+  /**
+   * Start announcing a universe.
+   *
+   * \param ev event loop to run the announcement timer on.
+   * \param universe_num universe number to announce.
+   * \throws std::system_error on system failures.
+   */
+  announcer(sd_event* ev, int universe_num);
+  announcer(const announcer& other)  = delete;
+  announcer(const announcer&& other) = delete;
+  announcer&
+  operator=(const announcer& other) = delete;
+  announcer&
+  operator=(const announcer&& other) = delete;
+
+  /**
+   * Change the universe number announced.
+   *
+   * \param universe_num new universe number.
+   */
+  void
+  set_universe(int universe_num) noexcept;
+};
+} // namespace e131_relay
+
+#endif /* E131_RELAY_HPP_ */
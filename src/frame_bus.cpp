@@ -0,0 +1,124 @@
+/**
+ * \file frame_bus.cpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <fcntl.h>
+#include <frame_bus.hpp>
+#include <new>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+namespace frame_bus
+{
+
+int
+publisher::listen_callback(sd_event_source* s, int fd, std::uint32_t revents,
+                           void* userdata) noexcept
+{
+  auto& pub{*reinterpret_cast<publisher*>(userdata)};
+  int conn;
+
+  while ((conn = accept4(fd, nullptr, nullptr,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+    e131_receiver::unique_fd reader{conn};
+    char byte{0};
+    iovec iov{&byte, sizeof(byte)};
+    alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int))> control{};
+    msghdr msg{};
+
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.data();
+    msg.msg_controllen = control.size();
+
+    auto* cmsg{CMSG_FIRSTHDR(&msg)};
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+    int bus_fd{pub.memfd};
+    std::memcpy(CMSG_DATA(cmsg), &bus_fd, sizeof(bus_fd));
+
+    /* Readers that do not take the descriptor can simply reconnect */
+    static_cast<void>(sendmsg(reader, &msg, MSG_NOSIGNAL));
+  }
+
+  return 0;
+}
+
+publisher::publisher(sd_event* ev, const std::string& socket_path,
+                     int universe_num)
+    : memfd{memfd_create("e131_blinkt frame bus",
+                         MFD_CLOEXEC | MFD_ALLOW_SEALING)},
+      listen_socket{socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK |
+                                        SOCK_CLOEXEC,
+                           0)},
+      path{socket_path}, universe{static_cast<std::uint16_t>(universe_num)}
+{
+  int r;
+  sd_event_source* s;
+  sockaddr_un addr{};
+
+  if ((memfd == -1) || (listen_socket == -1) ||
+      (ftruncate(memfd, sizeof(region)) == -1))
+    throw std::system_error{errno, std::system_category()};
+
+  void* m{mmap(nullptr, sizeof(region), PROT_READ | PROT_WRITE, MAP_SHARED,
+               memfd, 0)};
+  if (m == MAP_FAILED) throw std::system_error{errno, std::system_category()};
+  map.reset(new (m) region{});
+  map->header.magic   = bus_magic;
+  map->header.version = bus_version;
+  map->header.slots   = ring_size;
+
+  /* Readers may neither resize the bus nor, where supported, write to it */
+  int seals{F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL};
+#ifdef F_SEAL_FUTURE_WRITE
+  seals |= F_SEAL_FUTURE_WRITE;
+#endif
+  if (fcntl(memfd, F_ADD_SEALS, seals) == -1)
+    throw std::system_error{errno, std::system_category()};
+
+  if (path.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error{"frame bus socket path too long"};
+  addr.sun_family = AF_UNIX;
+  std::copy(path.begin(), path.end(), addr.sun_path);
+  unlink(path.c_str());
+
+  if (bind(listen_socket, reinterpret_cast<const sockaddr*>(&addr),
+           sizeof(addr)) == -1)
+    throw std::system_error{errno, std::system_category()};
+  bound.reset(path.c_str());
+
+  /* Any local process may read the bus */
+  if ((chmod(path.c_str(), 0666) == -1) || (listen(listen_socket, 8) == -1))
+    throw std::system_error{errno, std::system_category()};
+
+  if ((r = sd_event_add_io(ev, &s, listen_socket, EPOLLIN, listen_callback,
+                           this)) < 0)
+    throw std::system_error{-r, std::system_category()};
+  listen_evs.reset(s);
+}
+
+void
+publisher::publish(const channel_data_type& data, std::uint8_t prio) noexcept
+{
+  auto& slot{map->slots[published % ring_size]};
+  auto generation{slot.generation.load(std::memory_order_relaxed)};
+
+  slot.generation.store(generation + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.sequence = published;
+  slot.universe = universe;
+  slot.priority = prio;
+  slot.data     = data;
+  slot.generation.store(generation + 2, std::memory_order_release);
+
+  map->header.published.store(++published, std::memory_order_release);
+}
+} // namespace frame_bus
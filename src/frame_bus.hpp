@@ -0,0 +1,206 @@
+/**
+ * \file frame_bus.hpp
+ *
+ * Publication of arbitrated DMX frames to local processes through shared
+ * memory.
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#ifndef FRAME_BUS_HPP_
+#define FRAME_BUS_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deleters.hpp>
+#include <e131_receiver.hpp>
+#include <memory>
+#include <string>
+#include <systemd/sd-event.h>
+
+/**
+ * The frame bus is a ring of DMX frames in a memory file descriptor, handed
+ * to every process that connects to a Unix socket.
+ *
+ * The descriptor arrives as \c SCM_RIGHTS ancillary data, on a single
+ * message sent right after the connection is accepted; the connection is
+ * closed afterwards. Readers map the descriptor read-only as a \ref region,
+ * and read frames without any further system calls, or any coordination
+ * with the daemon.
+ *
+ * Each slot is guarded by a sequence lock: its generation counter is odd
+ * while the slot is being written. A frame read from a slot is consistent
+ * if the generation was even before the read, and unchanged after it. All
+ * fields are in host byte order.
+ */
+namespace frame_bus
+{
+using channel_data_type = e131_receiver::universe::channel_data_type;
+
+/**
+ * Number of frames held in the ring.
+ */
+constexpr std::uint32_t ring_size{8};
+
+/**
+ * Frame bus identifier.
+ */
+constexpr std::array<char, 8> bus_magic{'E', '1', '3', '1', 'B', 'U', 'S', 0};
+
+/**
+ * Current frame bus layout version.
+ */
+constexpr std::uint32_t bus_version{1};
+
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free,
+              "frame bus counters must be lock-free to be shared");
+
+/**
+ * Frame bus header.
+ */
+struct bus_header {
+  std::array<char, 8> magic;            ///< Bus identifier, \ref bus_magic
+  std::uint32_t version;                ///< Bus layout version
+  std::uint32_t slots;                  ///< Number of slots in the ring
+  std::atomic<std::uint32_t> published; ///< Number of frames published
+};
+
+/**
+ * Ring slot holding a single frame.
+ */
+struct alignas(64) frame_slot {
+  std::atomic<std::uint32_t> generation; ///< Odd while being written
+  std::uint32_t sequence;                ///< Number of the frame held
+  std::uint16_t universe;                ///< Universe the frame belongs to
+  std::uint8_t priority;                 ///< Priority of the frame
+  channel_data_type data;                ///< DMX channel data
+};
+
+/**
+ * Layout of the shared memory.
+ *
+ * Frame number \c n is held in slot <tt>n % ring_size</tt>, and the latest
+ * frame is number <tt>published - 1</tt>.
+ */
+struct region {
+  bus_header header;                       ///< Bus header
+  std::array<frame_slot, ring_size> slots; ///< Frame ring
+};
+
+/**
+ * Frame copied out of the bus by a reader.
+ */
+struct frame {
+  std::uint32_t sequence; ///< Number of the frame
+  std::uint16_t universe; ///< Universe the frame belongs to
+  std::uint8_t priority;  ///< Priority of the frame
+  channel_data_type data; ///< DMX channel data
+};
+
+/**
+ * Read the latest frame from a mapped bus.
+ *
+ * \param bus mapped bus.
+ * \param out set to the frame read.
+ * \retval true frame read.
+ * \retval false no frame published yet.
+ */
+inline bool
+read_latest(const region& bus, frame& out) noexcept
+{
+  std::uint32_t published;
+  std::uint32_t generation;
+
+  do {
+    published = bus.header.published.load(std::memory_order_acquire);
+    if (!published) return false;
+
+    const auto& slot{bus.slots[(published - 1) % ring_size]};
+    generation = slot.generation.load(std::memory_order_acquire);
+    if (generation & 1) continue;
+
+    out.sequence = slot.sequence;
+    out.universe = slot.universe;
+    out.priority = slot.priority;
+    out.data     = slot.data;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.generation.load(std::memory_order_relaxed) == generation) break;
+  } while (true);
+
+  return true;
+}
+
+/**
+ * Publishes frames on the bus, and hands the bus to connecting readers.
+ */
+class publisher
+{
+private:
+  e131_receiver::unique_fd memfd;         ///< Bus memory fd
+  e131_receiver::unique_fd listen_socket; ///< Unix socket fd
+  std::string path;                       ///< Unix socket path
+  std::unique_ptr<region, deleters::mapping<region>>
+      map{}; ///< Writable mapping of the bus
+  std::unique_ptr<const char, deleters::file_path>
+      bound{}; ///< Unix socket file, once bound to \ref path
+  std::uint32_t published{0};             ///< Number of frames published
+  std::uint16_t universe;                 ///< Universe of published frames
+  std::unique_ptr<sd_event_source, deleters::sd_event_source>
+      listen_evs{}; ///< Unix socket event source
+
+  /**
+   * Callback to be called by the event loop when readers are connecting.
+   *
+   * \see sd_event_add_io for more information regarding
+   *      function arguments.
+   * \retval 0 callback execution success.
+   * \retval nonzero callback execution failure.
+   */
+  static int
+  listen_callback(sd_event_source* s, int fd, std::uint32_t revents,
+                  void* userdata) noexcept;
+
+public:
+  /**
+   * Create the bus, and start listening for readers.
+   *
+   * \param ev event loop to accept readers on.
+   * \param socket_path path to bind the Unix socket to. Any existing file
+   *        at that path is replaced.
+   * \param universe_num universe number published frames belong to.
+   * \throws std::system_error on system failures.
+   */
+  publisher(sd_event* ev, const std::string& socket_path, int universe_num);
+  publisher(const publisher& other)  = delete;
+  publisher(const publisher&& other) = delete;
+  publisher&
+  operator=(const publisher& other) = delete;
+  publisher&
+  operator=(const publisher&& other) = delete;
+
+  /**
+   * Change the universe number published frames belong to.
+   *
+   * \param universe_num new universe number.
+   */
+  void
+  set_universe(int universe_num) noexcept
+  {
+    universe = static_cast<std::uint16_t>(universe_num);
+  }
+
+  /**
+   * Publish a frame, overwriting the oldest frame in the ring.
+   *
+   * \param data DMX channel data.
+   * \param prio priority of the data.
+   */
+  void
+  publish(const channel_data_type& data, std::uint8_t prio) noexcept;
+};
+} // namespace frame_bus
+
+#endif /* FRAME_BUS_HPP_ */
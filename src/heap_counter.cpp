@@ -0,0 +1,66 @@
+/**
+ * \file heap_counter.cpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <heap_counter.hpp>
+#include <new>
+
+namespace heap_counter
+{
+namespace
+{
+std::atomic<unsigned long> count{0}; ///< Allocations made so far
+
+/**
+ * Allocate memory, as the default \code operator new does.
+ *
+ * \param size number of bytes to allocate.
+ * \param alignment alignment of the allocation, or 0 for the default.
+ * \return allocated memory.
+ * \throws std::bad_alloc on failure to allocate memory.
+ */
+void*
+allocate(std::size_t size, std::size_t alignment)
+{
+  count.fetch_add(1, std::memory_order_relaxed);
+  if (!size) size = 1;
+
+  while (true) {
+    void* p{nullptr};
+    if (!alignment)
+      p = std::malloc(size);
+    else if (posix_memalign(&p, alignment, size))
+      p = nullptr;
+    if (p) return p;
+
+    auto handler{std::get_new_handler()};
+    if (!handler) throw std::bad_alloc{};
+    handler();
+  }
+}
+} // namespace
+
+unsigned long
+allocations() noexcept
+{
+  return count.load(std::memory_order_relaxed);
+}
+} // namespace heap_counter
+
+void*
+operator new(std::size_t size)
+{
+  return heap_counter::allocate(size, 0);
+}
+
+void*
+operator new(std::size_t size, std::align_val_t alignment)
+{
+  return heap_counter::allocate(size, static_cast<std::size_t>(alignment));
+}
@@ -0,0 +1,35 @@
+/**
+ * \file heap_counter.hpp
+ *
+ * Count of the heap allocations made by the process.
+ *
+ * \sa heap_counter.cpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#ifndef HEAP_COUNTER_HPP_
+#define HEAP_COUNTER_HPP_
+
+/**
+ * Counting of heap allocations, so that paths meant not to allocate can be
+ * checked.
+ *
+ * Allocations are counted by replacing the global \code operator new, which
+ * every allocation made by the C++ standard library goes through. Memory
+ * allocated by C libraries with \code malloc() directly is not counted.
+ */
+namespace heap_counter
+{
+/**
+ * Obtain the number of heap allocations made by the process so far.
+ *
+ * \return allocation count, which wraps around.
+ */
+unsigned long
+allocations() noexcept;
+} // namespace heap_counter
+
+#endif /* HEAP_COUNTER_HPP_ */
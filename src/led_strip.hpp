@@ -0,0 +1,681 @@
+/**
+ * \file led_strip.hpp
+ *
+ * LED strip driver using Linux userspace SPI support, specialized at compile
+ * time for the LED chip and the number of LEDs in the strip.
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#ifndef LED_STRIP_HPP_
+#define LED_STRIP_HPP_
+
+#include <algorithm>
+#include <apa102.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <linux/spi/spidev.h>
+#include <limits>
+#include <linux/types.h>
+#include <stdexcept>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <system_error>
+#include <trace.hpp>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace led_strip
+{
+/**
+ * APA102 LED chip.
+ *
+ * Each chip describes the layout of the SPI frame used to update a strip of
+ * such LEDs: a start frame, one fixed-size frame per LED, and an end frame.
+ * Start and end frames are all zeroes.
+ */
+struct apa102 {
+  using pixel_type = ::apa102::output; ///< LED output setting
+
+  static constexpr std::uint32_t clock_period{100}; ///< SPI clock period, ns
+  static constexpr std::size_t start_frame_size{
+      ::apa102::start_sequence.size()};             ///< Start frame bytes
+  static constexpr std::size_t pixel_size{4};       ///< Bytes per LED
+  static constexpr bool split_frames{true};         ///< Frames may pause
+
+  /**
+   * Calculate the size of the end frame.
+   *
+   * \param leds number of LEDs in the strip.
+   * \return end frame size, in bytes.
+   */
+  static constexpr std::size_t
+  end_frame_size(std::size_t leds) noexcept
+  {
+    return ::apa102::end_bytes_required(leds);
+  }
+
+  /**
+   * See \ref ::apa102::make_output()
+   */
+  static constexpr pixel_type
+  make_pixel(std::uint8_t brt, std::uint8_t red, std::uint8_t green,
+             std::uint8_t blue) noexcept
+  {
+    return ::apa102::make_output(brt, red, green, blue);
+  }
+
+  /**
+   * Encode the output setting of a LED into its SPI frame.
+   *
+   * \param p LED output setting.
+   * \param out start of the LED frame.
+   */
+  static void
+  encode(const pixel_type& p, std::uint8_t* out) noexcept
+  {
+    std::memcpy(out, ::apa102::encode(p).data(), pixel_size);
+  }
+};
+
+/**
+ * SK9822 LED chip.
+ *
+ * Uses the APA102 LED frame, but latches data only after an additional
+ * 32-bit reset frame of zeroes following the LED frames.
+ */
+struct sk9822 : public apa102 {
+  /**
+   * See \ref apa102::end_frame_size()
+   */
+  static constexpr std::size_t
+  end_frame_size(std::size_t leds) noexcept
+  {
+    return 4 + apa102::end_frame_size(leds);
+  }
+};
+
+/**
+ * WS2812 LED chip, driven through the SPI MOSI line.
+ *
+ * Each data bit is expanded into three SPI bits, \code 110 for a one and
+ * \code 100 for a zero, clocked out at 2.4 MHz. The end frame holds the line
+ * low for long enough to latch the data.
+ */
+struct ws2812 {
+  /**
+   * WS2812 LED output setting.
+   */
+  struct pixel_type {
+    std::uint8_t red;   ///< LED red channel
+    std::uint8_t green; ///< LED green channel
+    std::uint8_t blue;  ///< LED blue channel
+
+    constexpr bool
+    operator==(const pixel_type& other) const noexcept
+    {
+      return (red == other.red) && (green == other.green) &&
+             (blue == other.blue);
+    }
+
+    constexpr bool
+    operator!=(const pixel_type& other) const noexcept
+    {
+      return !(*this == other);
+    }
+  };
+
+  static constexpr std::uint32_t clock_period{416}; ///< SPI clock period, ns
+  static constexpr std::size_t start_frame_size{0}; ///< Start frame bytes
+  static constexpr std::size_t pixel_size{9};       ///< Bytes per LED
+  static constexpr bool split_frames{false};        ///< Pauses latch data
+
+  /**
+   * Calculate the size of the end frame, holding the line low for 300 us.
+   *
+   * \return end frame size, in bytes.
+   */
+  static constexpr std::size_t end_frame_size(std::size_t) noexcept
+  {
+    return 90;
+  }
+
+  /**
+   * Creates an output setting from brightness and RGB components.
+   *
+   * The WS2812 has no global brightness setting, so the brightness is
+   * applied to the RGB components.
+   *
+   * \param brt global brightness, in range [0, 0x1f]
+   * \param red red channel, in range [0, 0xff]
+   * \param green green channel, in range [0, 0xff]
+   * \param blue blue channel, in range [0, 0xff]
+   * \return output setting.
+   */
+  static constexpr pixel_type
+  make_pixel(std::uint8_t brt, std::uint8_t red, std::uint8_t green,
+             std::uint8_t blue) noexcept
+  {
+    return pixel_type{static_cast<std::uint8_t>((red * brt) / 0x1f),
+                      static_cast<std::uint8_t>((green * brt) / 0x1f),
+                      static_cast<std::uint8_t>((blue * brt) / 0x1f)};
+  }
+
+  /**
+   * Lookup table from a byte to its 3-byte SPI expansion.
+   */
+  static constexpr std::array<std::array<std::uint8_t, 3>, 256> expansion{
+      []() {
+        std::array<std::array<std::uint8_t, 3>, 256> table{};
+        for (unsigned int v{0}; v < table.size(); v++) {
+          std::uint32_t bits{0};
+          for (unsigned int bit{0}; bit < 8; bit++)
+            bits = (bits << 3) | (((v << bit) & 0x80) ? 0b110 : 0b100);
+          table[v] = {static_cast<std::uint8_t>(bits >> 16),
+                      static_cast<std::uint8_t>(bits >> 8),
+                      static_cast<std::uint8_t>(bits)};
+        }
+        return table;
+      }()};
+
+  /**
+   * Encode the output setting of a LED into its SPI frame.
+   *
+   * \param p LED output setting.
+   * \param out start of the LED frame.
+   */
+  static void
+  encode(const pixel_type& p, std::uint8_t* out) noexcept
+  {
+    std::memcpy(out, expansion[p.green].data(), 3);
+    std::memcpy(out + 3, expansion[p.red].data(), 3);
+    std::memcpy(out + 6, expansion[p.blue].data(), 3);
+  }
+};
+
+/**
+ * Class used to control a strip of LEDs connected to a SPI device.
+ *
+ * \tparam Chip LED chip, such as \ref apa102.
+ * \tparam N number of LEDs in the strip.
+ */
+template<typename Chip, std::size_t N>
+class strip
+{
+public:
+  using chip_type  = Chip;
+  using pixel_type = typename Chip::pixel_type;
+
+  /**
+   * Number of bytes clocked out on every update.
+   */
+  static constexpr std::size_t frame_size{Chip::start_frame_size +
+                                          (Chip::pixel_size * N) +
+                                          Chip::end_frame_size(N)};
+
+private:
+  /**
+   * Framebuffer holding the LED frames. Start and end frames are sent from
+   * \ref zeroes instead.
+   */
+  using framebuffer_type = std::array<std::uint8_t, Chip::pixel_size * N>;
+
+  /**
+   * Zeroes clocked out as the start and end frames.
+   */
+  static constexpr std::array<std::uint8_t,
+                              std::max(Chip::start_frame_size,
+                                       Chip::end_frame_size(N))>
+      zeroes{};
+
+  /**
+   * Largest number of transfers in a single SPI message.
+   */
+  static constexpr std::size_t max_message_transfers{
+      ((1 << _IOC_SIZEBITS) - 1) / sizeof(spi_ioc_transfer)};
+
+  /**
+   * Alignment spidev rounds every transfer up to when checking a message
+   * against its buffer size. This is \c ARCH_DMA_MINALIGN, which varies by
+   * architecture; 128 bytes covers all of them.
+   */
+  static constexpr std::size_t dma_alignment{128};
+
+  /**
+   * Range of \ref transfers sent as a single SPI message.
+   */
+  struct message {
+    std::size_t first; ///< Index of the first transfer
+    std::size_t count; ///< Number of transfers
+  };
+
+  int fd;
+  std::array<pixel_type, N> pixels{};
+  framebuffer_type framebuffer{};
+  std::vector<spi_ioc_transfer> transfers{}; ///< Transfers of a frame
+  std::vector<message> messages{};           ///< Messages sending a frame
+  std::vector<iovec> writes{};               ///< Writes sending a frame
+
+  /**
+   * Obtain the largest SPI message accepted by spidev.
+   *
+   * \return message size limit, in bytes.
+   */
+  static std::size_t
+  spidev_bufsiz()
+  {
+    std::size_t bufsiz{4096};
+    std::ifstream{"/sys/module/spidev/parameters/bufsiz"} >> bufsiz;
+    return bufsiz;
+  }
+
+  /**
+   * Obtain the request number of an \c SPI_IOC_MESSAGE() ioctl.
+   *
+   * \param count number of transfers in the message.
+   * \return request number.
+   */
+  static unsigned long
+  message_request(std::size_t count) noexcept
+  {
+    return _IOC(_IOC_WRITE, SPI_IOC_MAGIC, 0,
+                count * sizeof(spi_ioc_transfer));
+  }
+
+  /**
+   * Round a transfer length up to the length spidev accounts for it.
+   *
+   * \param len transfer length, in bytes.
+   * \return accounted length, in bytes.
+   */
+  static constexpr std::size_t
+  aligned(std::size_t len) noexcept
+  {
+    return (len + dma_alignment - 1) / dma_alignment * dma_alignment;
+  }
+
+  /**
+   * Append transfers sending a buffer, filling the current message before
+   * starting a new one.
+   *
+   * \param data start of the buffer.
+   * \param len number of bytes in the buffer.
+   * \param unit number of bytes that must not be split across messages.
+   * \param bufsiz largest message, in bytes, a multiple of
+   *        \ref dma_alignment.
+   * \param used number of bytes accounted to the current message, updated.
+   * \param tmpl transfer settings common to all transfers.
+   */
+  void
+  add_transfers(const std::uint8_t* data, std::size_t len, std::size_t unit,
+                std::size_t bufsiz, std::size_t& used,
+                const spi_ioc_transfer& tmpl)
+  {
+    for (std::size_t done{0}; done < len;) {
+      std::size_t room{bufsiz - used};
+      if (messages.empty() || (room < std::min(unit, len - done)) ||
+          (messages.back().count == max_message_transfers)) {
+        messages.push_back(message{transfers.size(), 0});
+        used = 0;
+        room = bufsiz;
+      }
+
+      auto xfer{tmpl};
+      xfer.tx_buf = reinterpret_cast<__u64>(data);
+      xfer.len    = std::min(room - (room % unit), len - done);
+      transfers.push_back(xfer);
+      writes.push_back(iovec{const_cast<std::uint8_t*>(data), xfer.len});
+      messages.back().count++;
+      used += aligned(xfer.len);
+      done += xfer.len;
+      /* Zeroes are sent from the start of the buffer every time */
+      if (data != zeroes.data()) data += xfer.len;
+    }
+  }
+
+  /**
+   * Plan the transfers and messages sending a frame.
+   *
+   * Transfers point straight at \ref framebuffer slices and at \ref zeroes,
+   * and are grouped into messages that each fit in the spidev buffer, as
+   * spidev rejects larger messages. Each transfer is counted at its aligned
+   * length, as spidev counts it. The same slices make up \ref writes.
+   *
+   * \param speed SPI clock frequency, in Hz.
+   * \throws std::runtime_error if the frame does not fit in a single
+   *         message but the chip cannot take it in several.
+   */
+  void
+  plan_transfers(std::uint32_t speed)
+  {
+    std::size_t used{0};
+    auto bufsiz{spidev_bufsiz() / dma_alignment * dma_alignment};
+    if (bufsiz < Chip::pixel_size)
+      throw std::runtime_error{"spidev buffer too small"};
+
+    spi_ioc_transfer tmpl;
+    std::memset(reinterpret_cast<void*>(&tmpl), 0, sizeof(tmpl));
+    tmpl.speed_hz      = speed;
+    tmpl.bits_per_word = 8;
+
+    /* LED frames are kept whole, so that slices line up with LEDs */
+    add_transfers(zeroes.data(), Chip::start_frame_size, 1, bufsiz, used,
+                  tmpl);
+    add_transfers(framebuffer.data(), framebuffer.size(), Chip::pixel_size,
+                  bufsiz, used, tmpl);
+    add_transfers(zeroes.data(), Chip::end_frame_size(N), 1, bufsiz, used,
+                  tmpl);
+    if (!Chip::split_frames && (messages.size() > 1))
+      throw std::runtime_error{"LED frame larger than the spidev buffer"};
+  }
+
+  /**
+   * Encode the output settings of all LEDs into the framebuffer.
+   *
+   * Expanded at compile time into one encode per LED.
+   */
+  template<std::size_t... I>
+  void
+  encode(std::index_sequence<I...>) noexcept
+  {
+    (Chip::encode(pixels[I], framebuffer.data() + (I * Chip::pixel_size)),
+     ...);
+  }
+
+public:
+  /**
+   * Construct a new object representing a strip of LEDs.
+   *
+   * \param path path to userspace SPI device.
+   * \param period clock waveform period, in nanoseconds
+   * \param reset whether to reset all LEDs to blank output
+   * \throws std::system_error on failure in process of acquiring control of
+   * SPI device, or failure in resetting LEDs to blank.
+   * \throws std::runtime_error if frames cannot be sent within the spidev
+   * buffer size.
+   */
+  strip(const std::string& path, std::uint32_t period = Chip::clock_period,
+        bool reset = false)
+      : fd{open(path.c_str(), O_RDWR)}
+  {
+    std::uint32_t spi_mode{SPI_MODE_0};
+    std::uint8_t spi_lsbfirst{0};
+    /* Also the speed of plain writes, which carry no transfer settings */
+    std::uint32_t spi_speed{UINT32_C(1000000000) / period};
+    if ((fd == -1) || (ioctl(fd, SPI_IOC_WR_MODE32, &spi_mode) == -1) ||
+        (ioctl(fd, SPI_IOC_WR_LSB_FIRST, &spi_lsbfirst) == -1) ||
+        (ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &spi_speed) == -1))
+      throw std::system_error{errno, std::system_category()};
+
+    fill(Chip::make_pixel(0x1f, 0, 0, 0));
+    plan_transfers(spi_speed);
+
+    if (reset) commit();
+  }
+
+  strip(const strip& other)  = delete;
+  strip(const strip&& other) = delete;
+  strip&
+  operator=(const strip& other) = delete;
+  strip&
+  operator=(const strip&& other) = delete;
+
+  /**
+   * Get the output setting of a particular LED.
+   *
+   * \param led index of the LED to access. Must be within
+   * the range \c 0 to the number of LEDs in the strip - 1
+   * \return output setting of that particular LED.
+   */
+  const pixel_type& operator[](std::size_t led) const
+  {
+    return pixels[led];
+  }
+
+  /**
+   * Set the output setting of a particular LED.
+   *
+   * \param led index of the LED to set the output setting for.
+   * \param v desired output setting.
+   */
+  void
+  set(std::size_t led, const pixel_type& v)
+  {
+    pixels[led] = v;
+  }
+
+  /**
+   * See \ref ::std::array::fill()
+   */
+  void
+  fill(const pixel_type& v)
+  {
+    pixels.fill(v);
+  }
+
+  /**
+   * Commit changes to the output settings to the actual LEDs.
+   *
+   * Frames larger than the spidev buffer are sent in several messages.
+   *
+   * \throws ::std::system_error on error while writing to the LEDs
+   */
+  void
+  commit()
+  {
+    int r{0};
+
+    encode(std::make_index_sequence<N>{});
+    E131_TRACE(spi_commit_begin, frame_size);
+    for (const auto& msg : messages) {
+      r = ioctl(fd, message_request(msg.count), transfers.data() + msg.first);
+      if (r == -1) break;
+    }
+    E131_TRACE(spi_commit_end, frame_size, r);
+    if (r == -1) throw std::system_error{errno, std::system_category()};
+  }
+
+  /**
+   * Encode changes to the output settings, and obtain the buffers sending
+   * them, to be written to the SPI device elsewhere instead of through
+   * \ref commit(), such as through io_uring.
+   *
+   * Each buffer fits in the spidev buffer, and is sent as an SPI message of
+   * its own by a single \c write(). A vectored write of all buffers sends
+   * a frame.
+   *
+   * \return buffers sending a frame, pointing into this object. Their
+   *         contents change on the next call, or on \ref commit().
+   */
+  const std::vector<iovec>&
+  prepare() noexcept
+  {
+    encode(std::make_index_sequence<N>{});
+    return writes;
+  }
+
+  /**
+   * Obtain the file descriptor of the userspace SPI device.
+   *
+   * \return SPI device fd.
+   */
+  int
+  device() const noexcept
+  {
+    return fd;
+  }
+
+  /**
+   * Obtain the number of LEDs controlled by this object.
+   *
+   * \return LED count.
+   */
+  static constexpr std::size_t
+  size() noexcept
+  {
+    return N;
+  }
+
+  /**
+   * Destructor for the strip object.
+   *
+   * Closes the file descriptor used to access the userspace SPI device.
+   */
+  ~strip()
+  {
+    if (fd != -1) close(fd);
+  }
+};
+
+/**
+ * Limiter keeping the current drawn by a strip within a budget, by lowering
+ * the global brightness of the strip.
+ *
+ * The current is estimated from RGB data as a weighted sum of the channel
+ * values, each channel drawing its full current at 0xff. The sum is taken
+ * with GCC vector extensions, so that it maps onto SSE or NEON registers
+ * without depending on the auto-vectorizer: four channels at a time over
+ * RGB data, or one LED at a time by \ref accumulate(), inside the loop
+ * converting the LEDs.
+ *
+ * \tparam N number of LEDs in the strip.
+ */
+template<std::size_t N>
+class current_limiter
+{
+private:
+  /**
+   * Channel values or currents, one per lane.
+   */
+  using lanes_type = std::uint32_t __attribute__((vector_size(16)));
+
+  /**
+   * Channel values, as loaded from RGB data.
+   */
+  using bytes_type = std::uint8_t __attribute__((vector_size(4)));
+
+  static constexpr std::size_t lanes{sizeof(lanes_type) /
+                                     sizeof(std::uint32_t)};
+  static constexpr std::size_t channels{3 * N};
+
+  std::array<lanes_type, (channels + lanes - 1) / lanes>
+      weights{};               ///< Full current per channel, in mA
+  lanes_type pixel_weights{};  ///< Full current per channel of an LED, in mA
+  std::uint32_t budget{0};     ///< Budget, in mA times 0xff
+
+  static_assert((UINT64_C(0xff) * 0xff * channels) <=
+                    std::numeric_limits<std::uint32_t>::max(),
+                "current estimate may overflow");
+
+  /**
+   * Calculate the global brightness keeping an estimate within the budget.
+   *
+   * \param estimate current estimate, in mA times 0xff.
+   * \return global brightness, in range [0, 0x1f].
+   */
+  std::uint8_t
+  scale(std::uint32_t estimate) const noexcept
+  {
+    if (estimate <= budget) return 0x1f;
+    return static_cast<std::uint8_t>((UINT64_C(0x1f) * budget) / estimate);
+  }
+
+public:
+  /**
+   * Running current estimate, summed one LED at a time by
+   * \ref accumulate() while the LEDs are converted.
+   */
+  using sum_type = lanes_type;
+
+  /**
+   * Construct a limiter that never limits.
+   */
+  current_limiter() = default;
+
+  /**
+   * Construct a limiter.
+   *
+   * \param budget_ma current budget, in mA, or 0 to disable limiting. Must
+   *        be below 2^24 mA.
+   * \param red_ma current drawn by a red channel at 0xff, in mA.
+   * \param green_ma current drawn by a green channel at 0xff, in mA.
+   * \param blue_ma current drawn by a blue channel at 0xff, in mA.
+   */
+  current_limiter(std::uint32_t budget_ma, std::uint8_t red_ma,
+                  std::uint8_t green_ma, std::uint8_t blue_ma) noexcept
+      : budget{budget_ma * 0xff}
+  {
+    const std::array<std::uint8_t, 3> pixel_ma{red_ma, green_ma, blue_ma};
+    for (std::size_t i{0}; i < channels; i++)
+      weights[i / lanes][i % lanes] = pixel_ma[i % 3];
+    for (std::size_t i{0}; i < pixel_ma.size(); i++)
+      pixel_weights[i] = pixel_ma[i];
+  }
+
+  /**
+   * Add the current drawn by an LED to a running estimate, in one vector
+   * multiply-add, from the channel values just converted.
+   *
+   * \param sum running estimate, zero-initialized before the first LED.
+   * \param red red channel value.
+   * \param green green channel value.
+   * \param blue blue channel value.
+   */
+  void
+  accumulate(sum_type& sum, std::uint8_t red, std::uint8_t green,
+             std::uint8_t blue) const noexcept
+  {
+    const bytes_type values{red, green, blue, 0};
+    sum += __builtin_convertvector(values, lanes_type) * pixel_weights;
+  }
+
+  /**
+   * Calculate the global brightness keeping the strip within the budget,
+   * from a running estimate summed over all LEDs.
+   *
+   * \param sum running estimate.
+   * \return global brightness, in range [0, 0x1f].
+   */
+  std::uint8_t
+  brightness(const sum_type& sum) const noexcept
+  {
+    if (!budget) return 0x1f;
+    return scale(sum[0] + sum[1] + sum[2]);
+  }
+
+  /**
+   * Calculate the global brightness keeping the strip within the budget.
+   *
+   * \param rgb RGB data for all LEDs, 3 bytes per LED.
+   * \return global brightness, in range [0, 0x1f].
+   */
+  std::uint8_t
+  brightness(const std::uint8_t* rgb) const noexcept
+  {
+    if (!budget) return 0x1f;
+
+    lanes_type sums{};
+    for (std::size_t i{0}; i < (channels / lanes); i++) {
+      bytes_type values;
+      std::memcpy(&values, rgb + (i * lanes), sizeof(values));
+      sums += __builtin_convertvector(values, lanes_type) * weights[i];
+    }
+
+    std::uint32_t estimate{0};
+    for (std::size_t i{0}; i < lanes; i++) estimate += sums[i];
+    for (std::size_t i{channels - (channels % lanes)}; i < channels; i++)
+      estimate += rgb[i] * weights[i / lanes][i % lanes];
+    return scale(estimate);
+  }
+};
+} // namespace led_strip
+
+#endif /* LED_STRIP_HPP_ */
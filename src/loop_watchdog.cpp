@@ -0,0 +1,130 @@
+/**
+ * \file loop_watchdog.cpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <algorithm>
+#include <loop_watchdog.hpp>
+#include <system_error>
+#include <systemd/sd-daemon.h>
+#include <systemd/sd-journal.h>
+
+namespace loop_watchdog
+{
+
+/**
+ * Longest interval between lag measurements, in microseconds.
+ */
+constexpr std::uint64_t max_interval{100000};
+
+int
+watchdog::timer_callback(sd_event_source* s, std::uint64_t usec,
+                         void* userdata) noexcept
+{
+  auto& wd{*reinterpret_cast<watchdog*>(userdata)};
+  const auto now{monotonic_usec()};
+  const auto lag{(now > usec) ? (now - usec) : 0};
+
+  std::size_t bucket{0};
+  while ((bucket < (buckets - 1)) && (lag >= (UINT64_C(1) << bucket)))
+    bucket++;
+  wd.histogram[bucket]++;
+  wd.worst_lag = std::max(wd.worst_lag, lag);
+
+  if (lag > wd.max_lag) {
+    /* The watchdog is left to expire if the loop stays this late */
+    if (wd.overrun)
+      sd_journal_print(LOG_WARNING,
+                       "Event loop lagged %.3f ms, last slow stage: "
+                       "%s (%.3f ms)",
+                       lag / 1000.0, wd.overrun, wd.overrun_usec / 1000.0);
+    else
+      sd_journal_print(LOG_WARNING, "Event loop lagged %.3f ms",
+                       lag / 1000.0);
+  } else if (wd.watchdog_usec &&
+             ((now - wd.last_ping) >= (wd.watchdog_usec / 2))) {
+    sd_notify(0, "WATCHDOG=1");
+    wd.last_ping = now;
+  }
+
+  sd_event_source_set_time(s, now + wd.interval);
+  return 0;
+}
+
+watchdog::watchdog(sd_event* ev, int max_lag_ms, int slow_stage_ms)
+{
+  int r;
+  sd_event_source* s;
+
+  set_limits(max_lag_ms, slow_stage_ms);
+  if ((r = sd_watchdog_enabled(0, &watchdog_usec)) < 0)
+    throw std::system_error{-r, std::system_category()};
+  if (!r) watchdog_usec = 0;
+
+  /* Measured often enough that several measurements fit in a ping */
+  busy_interval = watchdog_usec ? std::min(max_interval, watchdog_usec / 4)
+                                : max_interval;
+  interval  = busy_interval;
+  last_ping = monotonic_usec();
+
+  if ((r = sd_event_add_time(ev, &s, CLOCK_MONOTONIC, last_ping + interval, 1,
+                             timer_callback, this)) < 0)
+    throw std::system_error{-r, std::system_category()};
+  timer_evs.reset(s);
+
+  if ((r = sd_event_source_set_enabled(s, SD_EVENT_ON)) < 0)
+    throw std::system_error{-r, std::system_category()};
+}
+
+void
+watchdog::set_limits(int max_lag_ms, int slow_stage_ms) noexcept
+{
+  max_lag    = static_cast<std::uint64_t>(max_lag_ms) * 1000;
+  slow_stage = static_cast<std::uint64_t>(slow_stage_ms) * 1000;
+}
+
+void
+watchdog::set_idle(bool idle) noexcept
+{
+  auto* s{timer_evs.get()};
+
+  interval = idle ? (watchdog_usec / 2) : busy_interval;
+  if (!interval) {
+    sd_event_source_set_enabled(s, SD_EVENT_OFF);
+    return;
+  }
+
+  sd_event_source_set_time(s, monotonic_usec() + interval);
+  sd_event_source_set_enabled(s, SD_EVENT_ON);
+}
+
+void
+watchdog::finish(const char* name, std::uint64_t elapsed) noexcept
+{
+  if (elapsed <= slow_stage) return;
+
+  overrun      = name;
+  overrun_usec = elapsed;
+  sd_journal_print(LOG_WARNING, "Slow %s: %.3f ms", name, elapsed / 1000.0);
+}
+
+void
+watchdog::log_histogram() const noexcept
+{
+  sd_journal_print(LOG_INFO, "Longest event loop lag: %.3f ms.",
+                   worst_lag / 1000.0);
+  for (std::size_t i{0}; i < buckets; i++) {
+    if (!histogram[i]) continue;
+    if (i == (buckets - 1))
+      sd_journal_print(LOG_INFO, "Lag >= %llu us: %llu",
+                       1ULL << (i - 1),
+                       static_cast<unsigned long long>(histogram[i]));
+    else
+      sd_journal_print(LOG_INFO, "Lag < %llu us: %llu", 1ULL << i,
+                       static_cast<unsigned long long>(histogram[i]));
+  }
+}
+} // namespace loop_watchdog
@@ -0,0 +1,203 @@
+/**
+ * \file loop_watchdog.hpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#ifndef LOOP_WATCHDOG_HPP_
+#define LOOP_WATCHDOG_HPP_
+
+#include <array>
+#include <cstdint>
+#include <deleters.hpp>
+#include <memory>
+#include <systemd/sd-event.h>
+#include <time.h>
+
+/**
+ * Measurement of event loop responsiveness, tied to the service manager
+ * watchdog.
+ */
+namespace loop_watchdog
+{
+/**
+ * Obtain the current time of the monotonic clock.
+ *
+ * \return time, in microseconds.
+ */
+inline std::uint64_t
+monotonic_usec() noexcept
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * UINT64_C(1000000)) + (ts.tv_nsec / 1000);
+}
+
+/**
+ * Measures how late the event loop dispatches a periodic timer, and keeps
+ * the service manager watchdog fed only while that lag stays bounded.
+ *
+ * The lag is the difference between the time the timer was due and the time
+ * its callback actually runs; it grows whenever a callback blocks the loop.
+ * Lags are kept in a histogram of power-of-two buckets, in microseconds.
+ *
+ * \c WATCHDOG=1 is sent at half the watchdog interval set by the service
+ * manager, and withheld while the lag exceeds the bound, so that a wedged
+ * or persistently overloaded daemon is restarted.
+ */
+class watchdog
+{
+public:
+  /**
+   * Number of lag histogram buckets. Bucket \c n counts lags below
+   * <tt>2^n</tt> microseconds, the last bucket counting all longer lags.
+   */
+  static constexpr std::size_t buckets{24};
+
+  using histogram_type = std::array<std::uint64_t, buckets>;
+
+private:
+  std::uint64_t max_lag;          ///< Longest lag still feeding the watchdog
+  std::uint64_t slow_stage;       ///< Longest stage not logged as slow
+  std::uint64_t watchdog_usec{0}; ///< Service manager watchdog interval
+  std::uint64_t busy_interval;    ///< Interval between lag measurements
+  std::uint64_t interval;         ///< Interval in effect
+  std::uint64_t last_ping{0};     ///< Monotonic time of the last ping
+  std::uint64_t worst_lag{0};     ///< Longest lag measured
+  histogram_type histogram{};     ///< Lag histogram
+  const char* overrun{nullptr};   ///< Stage that overran last
+  std::uint64_t overrun_usec{0};  ///< Duration of that stage
+  std::unique_ptr<sd_event_source, deleters::sd_event_source>
+      timer_evs{}; ///< Lag measurement timer
+
+  /**
+   * Callback to be called by the event loop when the lag is to be measured.
+   *
+   * \see sd_event_add_time for more information regarding
+   *      function arguments.
+   * \retval 0 callback execution success.
+   * \retval nonzero callback execution failure.
+   */
+  static int
+  timer_callback(sd_event_source* s, std::uint64_t usec,
+                 void* userdata) noexcept;
+
+public:
+  /**
+   * Measures the time taken by a processing stage, from construction to
+   * destruction, and reports it to the watchdog.
+   */
+  class stage
+  {
+  private:
+    watchdog& wd;        ///< Watchdog to report to
+    const char* name;    ///< Name of the stage
+    std::uint64_t start; ///< Monotonic time the stage started
+
+  public:
+    /**
+     * Start timing a stage.
+     *
+     * \param w watchdog to report to.
+     * \param stage_name name of the stage, with static storage duration.
+     */
+    stage(watchdog& w, const char* stage_name) noexcept
+        : wd{w}, name{stage_name}, start{monotonic_usec()}
+    {
+    }
+    stage(const stage& other)  = delete;
+    stage(const stage&& other) = delete;
+    stage&
+    operator=(const stage& other) = delete;
+    stage&
+    operator=(const stage&& other) = delete;
+
+    ~stage()
+    {
+      wd.finish(name, monotonic_usec() - start);
+    }
+  };
+
+  /**
+   * Start measuring the lag of the event loop.
+   *
+   * \param ev event loop to measure.
+   * \param max_lag_ms longest lag, in milliseconds, for which the service
+   *        manager watchdog is still fed.
+   * \param slow_stage_ms longest processing stage, in milliseconds, that is
+   *        not logged as slow.
+   * \throws std::system_error on system failures.
+   */
+  watchdog(sd_event* ev, int max_lag_ms, int slow_stage_ms);
+  watchdog(const watchdog& other)  = delete;
+  watchdog(const watchdog&& other) = delete;
+  watchdog&
+  operator=(const watchdog& other) = delete;
+  watchdog&
+  operator=(const watchdog&& other) = delete;
+
+  /**
+   * Change the lag and stage bounds.
+   *
+   * \param max_lag_ms longest lag, in milliseconds, for which the service
+   *        manager watchdog is still fed.
+   * \param slow_stage_ms longest processing stage, in milliseconds, that is
+   *        not logged as slow.
+   */
+  void
+  set_limits(int max_lag_ms, int slow_stage_ms) noexcept;
+
+  /**
+   * Switch between measuring the lag, and only feeding the service manager
+   * watchdog while idle.
+   *
+   * While idle, the timer only runs as often as the service manager
+   * watchdog needs feeding, and not at all if it is disabled.
+   *
+   * \param idle whether the daemon is idle.
+   */
+  void
+  set_idle(bool idle) noexcept;
+
+  /**
+   * Record the completion of a processing stage, logging it if it overran.
+   *
+   * \param name name of the stage.
+   * \param elapsed time taken by the stage, in microseconds.
+   */
+  void
+  finish(const char* name, std::uint64_t elapsed) noexcept;
+
+  /**
+   * Obtain the lag histogram.
+   *
+   * \return histogram, as described for \ref buckets.
+   */
+  const histogram_type&
+  lag_histogram() const noexcept
+  {
+    return histogram;
+  }
+
+  /**
+   * Obtain the longest lag measured.
+   *
+   * \return lag, in microseconds.
+   */
+  std::uint64_t
+  longest_lag() const noexcept
+  {
+    return worst_lag;
+  }
+
+  /**
+   * Log the lag histogram to the journal.
+   */
+  void
+  log_histogram() const noexcept;
+};
+} // namespace loop_watchdog
+
+#endif /* LOOP_WATCHDOG_HPP_ */
@@ -0,0 +1,189 @@
+/**
+ * \file show_file.cpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <show_file.hpp>
+#include <sys/mman.h>
+#include <time.h>
+
+namespace show_file
+{
+
+/**
+ * Largest record: one run per changed channel, separated by unchanged
+ * channels.
+ */
+constexpr std::size_t max_record_size{
+    sizeof(record_header) +
+    ((std::tuple_size_v<channel_data_type> + 1) / 2) *
+        (sizeof(run_header) + 1)};
+
+/**
+ * Unchanged channels between two runs below which the runs are coalesced,
+ * as that takes less space than another run header.
+ */
+constexpr std::size_t run_gap{sizeof(run_header)};
+
+static std::uint64_t
+monotonic_usec() noexcept
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * UINT64_C(1000000)) + (ts.tv_nsec / 1000);
+}
+
+void
+recorder::reserve(std::size_t bytes)
+{
+  if ((used + bytes) <= capacity) return;
+
+  std::size_t extended{capacity + growth};
+  if (ftruncate(fd, extended) == -1)
+    throw std::system_error{errno, std::system_category()};
+
+  void* m{map ? mremap(map, capacity, extended, MREMAP_MAYMOVE)
+              : mmap(nullptr, extended, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd, 0)};
+  if (m == MAP_FAILED) throw std::system_error{errno, std::system_category()};
+
+  map      = reinterpret_cast<std::uint8_t*>(m);
+  capacity = extended;
+}
+
+recorder::recorder(const std::string& path)
+    : fd{open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)}
+{
+  if (fd == -1) throw std::system_error{errno, std::system_category()};
+
+  reserve(sizeof(file_header));
+  file_header header{file_magic, file_version,
+                     std::tuple_size_v<channel_data_type>};
+  std::memcpy(map, &header, sizeof(header));
+  used = sizeof(header);
+}
+
+void
+recorder::record(const channel_data_type& frame)
+{
+  std::uint64_t now{monotonic_usec()};
+  if (!started) {
+    first_frame = now;
+    started     = true;
+  }
+
+  reserve(max_record_size);
+
+  record_header rec{sizeof(record_header), 0, now - first_frame};
+  std::uint8_t* out{map + used + sizeof(rec)};
+
+  for (std::size_t i{0}; i < frame.size();) {
+    if (frame[i] == previous[i]) {
+      i++;
+      continue;
+    }
+
+    /* Extend the run until enough unchanged channels follow it */
+    std::size_t end{i + 1};
+    for (std::size_t j{end}; (j < frame.size()) && ((j - end) < run_gap); j++)
+      if (frame[j] != previous[j]) end = j + 1;
+
+    run_header run{static_cast<std::uint16_t>(i),
+                   static_cast<std::uint16_t>(end - i)};
+    std::memcpy(out, &run, sizeof(run));
+    std::memcpy(out + sizeof(run), frame.data() + i, end - i);
+    out += sizeof(run) + (end - i);
+    rec.size += sizeof(run) + (end - i);
+    rec.runs++;
+    i = end;
+  }
+
+  if (!rec.runs) return;
+
+  std::memcpy(map + used, &rec, sizeof(rec));
+  used += rec.size;
+  previous = frame;
+}
+
+recorder::~recorder()
+{
+  if (map) munmap(map, capacity);
+  if (fd != -1) static_cast<void>(ftruncate(fd, used));
+}
+
+player::player(const std::string& path)
+{
+  e131_receiver::unique_fd fd{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+  struct stat st;
+
+  if ((fd == -1) || (fstat(fd, &st) == -1))
+    throw std::system_error{errno, std::system_category()};
+
+  file_header header;
+  if (static_cast<std::size_t>(st.st_size) < sizeof(header))
+    throw std::runtime_error{"not a show file"};
+
+  void* m{mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)};
+  if (m == MAP_FAILED) throw std::system_error{errno, std::system_category()};
+  map  = reinterpret_cast<const std::uint8_t*>(m);
+  size = st.st_size;
+  madvise(m, size, MADV_SEQUENTIAL);
+
+  std::memcpy(&header, map, sizeof(header));
+  if ((header.magic != file_magic) || (header.version != file_version) ||
+      (header.channels != std::tuple_size_v<channel_data_type>)) {
+    munmap(m, size);
+    throw std::runtime_error{"not a show file"};
+  }
+
+  start(0);
+}
+
+void
+player::start(std::uint64_t now) noexcept
+{
+  position = sizeof(file_header);
+  current.fill(0);
+  base = now;
+}
+
+bool
+player::next(std::uint64_t& deadline)
+{
+  record_header rec;
+
+  if ((size - position) < sizeof(rec)) return false;
+  std::memcpy(&rec, map + position, sizeof(rec));
+  /* The file is only trimmed once the recording is complete */
+  if (!rec.size) return false;
+  if ((rec.size < sizeof(rec)) || (rec.size > (size - position)))
+    throw std::runtime_error{"malformed show file record"};
+
+  const std::uint8_t* in{map + position + sizeof(rec)};
+  const std::uint8_t* end{map + position + rec.size};
+  for (std::uint32_t i{0}; i < rec.runs; i++) {
+    run_header run;
+    if (static_cast<std::size_t>(end - in) < sizeof(run))
+      throw std::runtime_error{"malformed show file record"};
+    std::memcpy(&run, in, sizeof(run));
+    in += sizeof(run);
+    if ((run.length > static_cast<std::size_t>(end - in)) ||
+        ((run.offset + run.length) > current.size()))
+      throw std::runtime_error{"malformed show file record"};
+    std::memcpy(current.data() + run.offset, in, run.length);
+    in += run.length;
+  }
+
+  position += rec.size;
+  deadline = base + rec.time;
+  return true;
+}
+
+player::~player()
+{
+  munmap(const_cast<std::uint8_t*>(map), size);
+}
+} // namespace show_file
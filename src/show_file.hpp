@@ -0,0 +1,201 @@
+/**
+ * \file show_file.hpp
+ *
+ * Recording and playback of DMX channel data to and from show files.
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#ifndef SHOW_FILE_HPP_
+#define SHOW_FILE_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <e131_receiver.hpp>
+#include <string>
+
+/**
+ * Show files hold a sequence of timestamped DMX frames.
+ *
+ * A show file begins with a \ref file_header, followed by records, each
+ * holding one frame. Records begin with a \ref record_header, followed by
+ * runs of channels that changed from the previous frame, each made up of a
+ * \ref run_header and the new channel values. Records are appended
+ * until the end of the file, or until a record of size zero. All fields are
+ * in host byte order.
+ */
+namespace show_file
+{
+using channel_data_type = e131_receiver::universe::channel_data_type;
+
+/**
+ * Show file header.
+ */
+struct file_header {
+  std::array<char, 8> magic; ///< File identifier, \ref file_magic
+  std::uint32_t version;     ///< File format version
+  std::uint32_t channels;    ///< DMX channels per frame
+};
+
+/**
+ * Frame record header.
+ */
+struct record_header {
+  std::uint32_t size; ///< Record size in bytes, including this header
+  std::uint32_t runs; ///< Number of channel runs in the record
+  std::uint64_t time; ///< Time since the first frame, in microseconds
+};
+
+/**
+ * Channel run header.
+ */
+struct run_header {
+  std::uint16_t offset; ///< Index of the first channel in the run
+  std::uint16_t length; ///< Number of channels in the run
+};
+
+/**
+ * Show file identifier.
+ */
+constexpr std::array<char, 8> file_magic{'E', '1', '3', '1',
+                                         'S', 'H', 'O', 'W'};
+
+/**
+ * Current show file format version.
+ */
+constexpr std::uint32_t file_version{1};
+
+/**
+ * Records frames into a show file, through a shared memory mapping that is
+ * extended as the show grows.
+ */
+class recorder
+{
+private:
+  /**
+   * Amount by which the file is extended when full.
+   */
+  static constexpr std::size_t growth{1 << 20};
+
+  e131_receiver::unique_fd fd;  ///< Show file fd
+  std::uint8_t* map{nullptr};   ///< Mapping of the show file
+  std::size_t capacity{0};      ///< Size of the mapping
+  std::size_t used{0};          ///< Bytes written to the mapping
+  channel_data_type previous{}; ///< Previously recorded frame
+  std::uint64_t first_frame{0}; ///< Monotonic time of the first frame
+  bool started{false};          ///< Whether a frame has been recorded
+
+  /**
+   * Ensure that the mapping has room for a number of additional bytes.
+   *
+   * \param bytes number of bytes.
+   * \throws std::system_error on failure to extend the file or mapping.
+   */
+  void
+  reserve(std::size_t bytes);
+
+public:
+  /**
+   * Create a new show file, replacing any existing file.
+   *
+   * \param path path to the show file.
+   * \throws std::system_error on failure to create or map the file.
+   */
+  explicit recorder(const std::string& path);
+  recorder(const recorder& other)  = delete;
+  recorder(const recorder&& other) = delete;
+  recorder&
+  operator=(const recorder& other) = delete;
+  recorder&
+  operator=(const recorder&& other) = delete;
+
+  /**
+   * Append a frame to the show, timestamped with the current time.
+   *
+   * Frames identical to the previous frame are not recorded.
+   *
+   * \param frame DMX channel data.
+   * \throws std::system_error on failure to extend the file.
+   */
+  void
+  record(const channel_data_type& frame);
+
+  /**
+   * Unmaps the show file, and trims it to the records written.
+   */
+  ~recorder();
+};
+
+/**
+ * Plays frames back from a show file.
+ *
+ * The file is mapped read-only, and paged in as playback proceeds.
+ */
+class player
+{
+private:
+  const std::uint8_t* map{nullptr}; ///< Mapping of the show file
+  std::size_t size{0};              ///< Size of the mapping
+  std::size_t position{0};          ///< Offset of the next record
+  channel_data_type current{};      ///< Current frame
+  std::uint64_t base{0};            ///< Monotonic time of playback start
+
+public:
+  /**
+   * Open a show file for playback.
+   *
+   * \param path path to the show file.
+   * \throws std::system_error on failure to open or map the file.
+   * \throws std::runtime_error if the file is not a show file.
+   */
+  explicit player(const std::string& path);
+  player(const player& other)  = delete;
+  player(const player&& other) = delete;
+  player&
+  operator=(const player& other) = delete;
+  player&
+  operator=(const player&& other) = delete;
+
+  /**
+   * Restart playback from the first frame.
+   *
+   * \param now monotonic time at which the first frame is due, in
+   *        microseconds.
+   */
+  void
+  start(std::uint64_t now) noexcept;
+
+  /**
+   * Advance to the next frame.
+   *
+   * \param deadline set to the monotonic time at which the frame is due, in
+   *        microseconds.
+   * \retval true frame available through \ref frame().
+   * \retval false end of show reached.
+   * \throws std::runtime_error if the record is malformed.
+   */
+  bool
+  next(std::uint64_t& deadline);
+
+  /**
+   * Obtain the current frame.
+   *
+   * \return DMX channel data.
+   */
+  const channel_data_type&
+  frame() const noexcept
+  {
+    return current;
+  }
+
+  /**
+   * Unmaps the show file.
+   */
+  ~player();
+};
+} // namespace show_file
+
+#endif /* SHOW_FILE_HPP_ */
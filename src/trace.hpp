@@ -0,0 +1,90 @@
+/**
+ * \file trace.hpp
+ *
+ * Static tracepoints, for tracing the running daemon with \c bpftrace or
+ * \c perf.
+ *
+ * Tracepoints are USDT probes under the \c e131_blinkt provider, compiled in
+ * when \c sys/sdt.h is available (\c HAVE_SYS_SDT_H). A disabled probe is a
+ * single \c nop instruction; its arguments are still evaluated, so they are
+ * kept to values at hand. Without \c sys/sdt.h, tracepoints compile to
+ * nothing.
+ *
+ * Probes and their arguments:
+ * - \c packet_received: universe, bytes, arrival time (us, \c CLOCK_MONOTONIC)
+ * - \c source_added: universe, CID hash, priority
+ * - \c source_removed: universe, CID hash
+ * - \c arbitration: universe, CID hash, sequence, priority, outcome
+ *   (\ref arbitration_outcome), bytes
+ * - \c frame_converted: universe, channel offset, bytes, whether changed
+ * - \c spi_commit_begin: bytes
+ * - \c spi_commit_end: bytes, \c ioctl() result, or the write result with
+ *   io_uring
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#ifndef TRACE_HPP_
+#define TRACE_HPP_
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+/**
+ * Fire a tracepoint.
+ *
+ * \param name probe name.
+ * \param ... probe arguments, at most 12 integers or pointers.
+ */
+#define E131_TRACE(name, ...) STAP_PROBEV(e131_blinkt, name, ##__VA_ARGS__)
+#else
+#define E131_TRACE(name, ...) ::trace::discard(__VA_ARGS__)
+#endif
+
+namespace trace
+{
+/**
+ * Swallow the arguments of a tracepoint that is compiled out, so that they
+ * are not reported as unused.
+ */
+template<typename... Args>
+inline void
+discard(const Args&...) noexcept
+{
+}
+
+/**
+ * Outcome of the arbitration of a packet, as reported by the
+ * \c arbitration probe.
+ */
+enum arbitration_outcome : int {
+  rejected_sequence = 0, ///< Dropped as out of sequence
+  rejected_priority = 1, ///< Outranked, or not DMX level data
+  applied           = 2, ///< Copied to the universe data
+  merged            = 3, ///< Passed to the HTP merge engine
+  terminated        = 4, ///< Source terminated the stream
+};
+
+/**
+ * Fold a 16-byte CID into a single probe argument.
+ *
+ * \param uuid start of the CID.
+ * \return CID hash.
+ */
+inline std::uint64_t
+cid_hash(const std::uint8_t* uuid) noexcept
+{
+  std::uint64_t hi;
+  std::uint64_t lo;
+
+  std::memcpy(&hi, uuid, sizeof(hi));
+  std::memcpy(&lo, uuid + sizeof(hi), sizeof(lo));
+  return hi ^ lo;
+}
+} // namespace trace
+
+#endif /* TRACE_HPP_ */
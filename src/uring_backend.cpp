@@ -0,0 +1,369 @@
+/**
+ * \file uring_backend.cpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <endian.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <trace.hpp>
+#include <unistd.h>
+#include <uring_backend.hpp>
+#include <utility>
+
+namespace uring_backend
+{
+
+mapping::mapping(std::size_t length, int fd, off_t offset)
+    : addr{mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                (fd == -1) ? (MAP_PRIVATE | MAP_ANONYMOUS)
+                           : (MAP_SHARED | MAP_POPULATE),
+                fd, offset)},
+      len{length}
+{
+  if (addr == MAP_FAILED) {
+    addr = nullptr;
+    throw std::system_error{errno, std::system_category()};
+  }
+}
+
+mapping::mapping(mapping&& other) noexcept
+    : addr{std::exchange(other.addr, nullptr)},
+      len{std::exchange(other.len, 0)}
+{
+}
+
+mapping&
+mapping::operator=(mapping&& other) noexcept
+{
+  std::swap(addr, other.addr);
+  std::swap(len, other.len);
+  return *this;
+}
+
+mapping::~mapping()
+{
+  if (addr) munmap(addr, len);
+}
+
+ring::ring(unsigned entries)
+{
+  io_uring_params params{};
+  /* Completions are only posted while waiting for them, by this thread */
+  params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+  ring_fd.reset(
+      static_cast<int>(syscall(__NR_io_uring_setup, entries, &params)));
+  if (ring_fd == -1) throw std::system_error{errno, std::system_category()};
+
+  std::size_t sq_size{params.sq_off.array +
+                      (params.sq_entries * sizeof(unsigned))};
+  std::size_t cq_size{params.cq_off.cqes +
+                      (params.cq_entries * sizeof(io_uring_cqe))};
+  bool single_map{(params.features & IORING_FEAT_SINGLE_MMAP) != 0};
+  if (single_map) sq_size = cq_size = std::max(sq_size, cq_size);
+
+  sq_map = mapping{sq_size, ring_fd, IORING_OFF_SQ_RING};
+  if (!single_map) cq_map = mapping{cq_size, ring_fd, IORING_OFF_CQ_RING};
+  const auto& cq_ring{single_map ? sq_map : cq_map};
+  sqe_map = mapping{params.sq_entries * sizeof(io_uring_sqe), ring_fd,
+                    IORING_OFF_SQES};
+
+  sqes       = sqe_map.at<io_uring_sqe>(0);
+  sq_head    = sq_map.at<unsigned>(params.sq_off.head);
+  sq_tail    = sq_map.at<unsigned>(params.sq_off.tail);
+  sq_mask    = *sq_map.at<unsigned>(params.sq_off.ring_mask);
+  sq_entries = params.sq_entries;
+  sqe_tail   = *sq_tail;
+  cq_head    = cq_ring.at<unsigned>(params.cq_off.head);
+  cq_tail    = cq_ring.at<unsigned>(params.cq_off.tail);
+  cq_mask    = *cq_ring.at<unsigned>(params.cq_off.ring_mask);
+  cqes       = cq_ring.at<io_uring_cqe>(params.cq_off.cqes);
+
+  /* Entries are always submitted in order, through an identity mapping */
+  auto* sq_array{sq_map.at<unsigned>(params.sq_off.array)};
+  for (unsigned i{0}; i < sq_entries; i++) sq_array[i] = i;
+}
+
+io_uring_sqe&
+ring::next_sqe(unsigned count)
+{
+  if ((sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) + count) >
+      sq_entries)
+    submit_and_wait(0);
+
+  auto& sqe{sqes[sqe_tail++ & sq_mask]};
+  std::memset(&sqe, 0, sizeof(sqe));
+  return sqe;
+}
+
+void
+ring::submit_and_wait(unsigned wait_nr)
+{
+  __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+  unsigned flags{wait_nr ? IORING_ENTER_GETEVENTS : 0U};
+
+  while (true) {
+    unsigned queued{sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE)};
+    if (syscall(__NR_io_uring_enter, static_cast<int>(ring_fd), queued,
+                wait_nr, flags, nullptr, 0) != -1)
+      break;
+    /* Completions must be consumed first when they are backlogged */
+    if ((errno == EAGAIN) || (errno == EBUSY)) break;
+    if (errno != EINTR) throw std::system_error{errno, std::system_category()};
+  }
+}
+
+void
+ring::register_buffer_ring(io_uring_buf_reg& reg)
+{
+  if (syscall(__NR_io_uring_register, static_cast<int>(ring_fd),
+              IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+    throw std::system_error{errno, std::system_category()};
+}
+
+backend::backend(e131_receiver::universe& universe, sd_event* event_loop,
+                 unsigned entries)
+    : uni{universe}, ev{event_loop}, buffers(entries * buffer_size),
+      uring{entries}
+{
+  if (!entries || (entries & (entries - 1)) || (entries > 32768))
+    throw std::invalid_argument{"invalid io_uring size"};
+
+  /* The buffer ring must be page-aligned, which mappings always are */
+  buf_ring_map = mapping{entries * sizeof(io_uring_buf), -1, 0};
+  buf_ring     = buf_ring_map.at<io_uring_buf_ring>(0);
+  bufs         = buf_ring_map.at<io_uring_buf>(0);
+  buf_mask     = entries - 1;
+
+  io_uring_buf_reg reg{};
+  reg.ring_addr    = reinterpret_cast<std::uint64_t>(buf_ring);
+  reg.ring_entries = entries;
+  reg.bgid         = buffer_group;
+  uring.register_buffer_ring(reg);
+  for (unsigned i{0}; i < entries; i++) recycle(i);
+
+  /* Sender addresses are not needed, so no room is left for them */
+  rx_header.msg_namelen    = 0;
+  rx_header.msg_controllen = control_size;
+  write_timeout.tv_nsec    = output_timeout * 1000;
+  tick.tv_nsec             = housekeeping_interval * 1000;
+
+  int r;
+  if ((r = sd_event_get_fd(ev)) < 0)
+    throw std::system_error{-r, std::system_category()};
+
+  /* Only fails when there is no socket, and then leaves nothing changed */
+  if ((e131_socket = uni.detach_socket()) == -1)
+    throw std::invalid_argument{"universe has no E1.31 socket"};
+  arm_receive();
+  arm_event_poll();
+}
+
+void
+backend::arm_receive()
+{
+  auto& sqe{uring.next_sqe()};
+  sqe.opcode    = IORING_OP_RECVMSG;
+  sqe.fd        = e131_socket;
+  sqe.addr      = reinterpret_cast<std::uint64_t>(&rx_header);
+  sqe.ioprio    = IORING_RECV_MULTISHOT;
+  sqe.flags     = IOSQE_BUFFER_SELECT;
+  sqe.buf_group = buffer_group;
+  sqe.user_data = receive_request;
+}
+
+void
+backend::arm_event_poll()
+{
+  std::uint32_t events{POLLIN};
+#if __BYTE_ORDER == __BIG_ENDIAN
+  /* The kernel reads the halves of the mask swapped on big-endian hosts */
+  events = (events << 16) | (events >> 16);
+#endif
+
+  auto& sqe{uring.next_sqe()};
+  sqe.opcode        = IORING_OP_POLL_ADD;
+  sqe.fd            = sd_event_get_fd(ev);
+  sqe.poll32_events = events;
+  sqe.len           = IORING_POLL_ADD_MULTI;
+  sqe.user_data     = event_request;
+}
+
+void
+backend::submit_output()
+{
+  const auto& iov{encode()};
+  output_bytes = 0;
+  for (const auto& v : iov) output_bytes += v.iov_len;
+  E131_TRACE(spi_commit_begin, output_bytes);
+
+  auto& write{uring.next_sqe(2)};
+  write.opcode    = IORING_OP_WRITEV;
+  write.fd        = output_fd;
+  write.addr      = reinterpret_cast<std::uint64_t>(iov.data());
+  write.len       = iov.size();
+  write.off       = static_cast<std::uint64_t>(-1);
+  write.flags     = IOSQE_IO_LINK;
+  write.user_data = output_request;
+
+  auto& timeout{uring.next_sqe()};
+  timeout.opcode    = IORING_OP_LINK_TIMEOUT;
+  timeout.addr      = reinterpret_cast<std::uint64_t>(&write_timeout);
+  timeout.len       = 1;
+  timeout.user_data = output_timeout_request;
+
+  output_busy    = true;
+  output_pending = false;
+}
+
+void
+backend::recycle(std::uint16_t bid) noexcept
+{
+  auto& buf{bufs[buf_tail & buf_mask]};
+  buf.addr = reinterpret_cast<std::uint64_t>(buffers.data() +
+                                             (bid * buffer_size));
+  buf.len  = buffer_size;
+  buf.bid  = bid;
+  __atomic_store_n(&buf_ring->tail, ++buf_tail, __ATOMIC_RELEASE);
+}
+
+bool
+backend::receive(const io_uring_cqe& cqe,
+                 const e131_receiver::clock_reading& clocks)
+{
+  /* Ends once the buffers run out, and is then queued again */
+  if (!(cqe.flags & IORING_CQE_F_MORE)) arm_receive();
+  if (cqe.res == -ENOBUFS) return false;
+  if (cqe.res < 0) throw std::system_error{-cqe.res, std::system_category()};
+  if (!(cqe.flags & IORING_CQE_F_BUFFER)) return false;
+
+  std::uint16_t bid(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+  auto* buf{buffers.data() + (bid * buffer_size)};
+  io_uring_recvmsg_out out;
+  std::memcpy(&out, buf, sizeof(out));
+
+  /* Header, then the room left for the address and ancillary data */
+  auto* control{buf + sizeof(out) + rx_header.msg_namelen};
+  auto* payload{control + rx_header.msg_controllen};
+  std::size_t len{std::min<std::size_t>(
+      out.payloadlen, buffer_size - static_cast<std::size_t>(payload - buf))};
+
+  msghdr hdr{};
+  hdr.msg_control    = control;
+  hdr.msg_controllen = out.controllen;
+  auto arrival{e131_receiver::universe::arrival_time(hdr, clocks)};
+  E131_TRACE(packet_received, uni.universe_number(), len, arrival);
+
+  try {
+    uni.process_packet(payload, len, arrival);
+  } catch (...) {
+    recycle(bid);
+    throw;
+  }
+  recycle(bid);
+  return true;
+}
+
+void
+backend::output_done(const io_uring_cqe& cqe)
+{
+  output_busy = false;
+  E131_TRACE(spi_commit_end, output_bytes, cqe.res);
+
+  /* Cancelled by its linked timeout */
+  if (cqe.res == -ECANCELED)
+    throw std::system_error{ETIMEDOUT, std::system_category()};
+  if (cqe.res < 0) throw std::system_error{-cqe.res, std::system_category()};
+  if (static_cast<std::size_t>(cqe.res) != output_bytes)
+    throw std::system_error{EIO, std::system_category()};
+
+  if (output_pending) submit_output();
+}
+
+void
+backend::dispatch()
+{
+  int r{0};
+
+  while ((sd_event_get_state(ev) != SD_EVENT_FINISHED) &&
+         ((r = sd_event_run(ev, 0)) > 0))
+    ;
+  if (r < 0) throw std::system_error{-r, std::system_category()};
+}
+
+void
+backend::set_output(int fd, frame_source source)
+{
+  output_fd = fd;
+  encode    = std::move(source);
+}
+
+void
+backend::commit()
+{
+  if (output_fd == -1) return;
+  if (output_busy) {
+    output_pending = true;
+    return;
+  }
+  submit_output();
+}
+
+std::size_t
+backend::run()
+{
+  std::size_t packets{0};
+  bool pending{false};
+
+  /* Timers of the event loop are only armed by running it */
+  if (!prepared) {
+    dispatch();
+    prepared = true;
+  }
+  uring.submit_and_wait(1);
+  auto clocks{e131_receiver::clock_reading::now()};
+  uring.for_each_completion([&](const io_uring_cqe& cqe) {
+    switch (cqe.user_data) {
+    case receive_request:
+      if (receive(cqe, clocks)) packets++;
+      break;
+    case event_request:
+      if (cqe.res < 0)
+        throw std::system_error{-cqe.res, std::system_category()};
+      if (!(cqe.flags & IORING_CQE_F_MORE)) arm_event_poll();
+      pending = true;
+      break;
+    case output_request:
+      output_done(cqe);
+      break;
+    case housekeeping_request:
+      housekeeping_armed = false;
+      pending            = true;
+      break;
+    default:
+      /* Linked timeouts complete with the write they bound */
+      break;
+    }
+  });
+
+  if (pending) dispatch();
+  if (packets && !housekeeping_armed) {
+    auto& sqe{uring.next_sqe()};
+    sqe.opcode         = IORING_OP_TIMEOUT;
+    sqe.addr           = reinterpret_cast<std::uint64_t>(&tick);
+    sqe.len            = 1;
+    sqe.user_data      = housekeeping_request;
+    housekeeping_armed = true;
+  }
+  return packets;
+}
+} // namespace uring_backend
@@ -0,0 +1,372 @@
+/**
+ * \file uring_backend.hpp
+ *
+ * Receive and output path driven through a single io_uring instance.
+ *
+ * \sa uring_backend.cpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#ifndef URING_BACKEND_HPP_
+#define URING_BACKEND_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <e131_receiver.hpp>
+#include <functional>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <systemd/sd-event.h>
+#include <vector>
+
+/**
+ * Alternative to receiving through the \c sd-event loop, in which a single
+ * \c io_uring_enter() both submits LED output and waits for E1.31 packets.
+ */
+namespace uring_backend
+{
+/**
+ * Memory mapping, unmapped on destruction.
+ */
+class mapping
+{
+  void* addr{nullptr}; ///< Start of the mapping, or \c nullptr
+  std::size_t len{0};  ///< Length of the mapping
+
+public:
+  mapping() = default;
+
+  /**
+   * Map memory.
+   *
+   * \param length length of the mapping.
+   * \param fd file to map shared, or -1 for private anonymous memory.
+   * \param offset offset into the file.
+   * \throws std::system_error on failure to map the memory.
+   */
+  mapping(std::size_t length, int fd, off_t offset);
+  mapping(const mapping& other) = delete;
+  mapping(mapping&& other) noexcept;
+  mapping&
+  operator=(const mapping& other) = delete;
+  mapping&
+  operator=(mapping&& other) noexcept;
+  ~mapping();
+
+  /**
+   * Obtain an object in the mapping.
+   *
+   * \param offset offset of the object into the mapping.
+   * \return pointer to the object.
+   */
+  template<typename T>
+  T*
+  at(std::size_t offset) const noexcept
+  {
+    return reinterpret_cast<T*>(static_cast<char*>(addr) + offset);
+  }
+};
+
+/**
+ * io_uring instance, set up with raw system calls.
+ *
+ * Requires Linux 6.1 or later, for deferred task running, which also
+ * brings multishot \c recvmsg() and provided buffer rings.
+ */
+class ring
+{
+  e131_receiver::unique_fd ring_fd; ///< io_uring fd
+  mapping sq_map{};                 ///< Submission queue ring
+  mapping cq_map{};                 ///< Completion queue ring, if separate
+  mapping sqe_map{};                ///< Submission queue entries
+  io_uring_sqe* sqes{nullptr};      ///< Submission queue entries
+  unsigned* sq_head{nullptr};       ///< Submission queue head, shared
+  unsigned* sq_tail{nullptr};       ///< Submission queue tail, shared
+  unsigned sq_mask{0};              ///< Submission queue index mask
+  unsigned sq_entries{0};           ///< Submission queue size
+  unsigned sqe_tail{0};             ///< Tail including unsubmitted entries
+  unsigned* cq_head{nullptr};       ///< Completion queue head, shared
+  unsigned* cq_tail{nullptr};       ///< Completion queue tail, shared
+  unsigned cq_mask{0};              ///< Completion queue index mask
+  io_uring_cqe* cqes{nullptr};      ///< Completion queue entries
+
+public:
+  /**
+   * Set up a ring.
+   *
+   * \param entries submission queue size, a power of 2.
+   * \throws std::system_error on failure to set up the ring, with
+   *         \c ENOSYS or \c EPERM where io_uring is unavailable, and
+   *         \c EINVAL on kernels that are too old.
+   */
+  explicit ring(unsigned entries);
+  ring(const ring& other)  = delete;
+  ring(const ring&& other) = delete;
+  ring&
+  operator=(const ring& other) = delete;
+  ring&
+  operator=(const ring&& other) = delete;
+
+  /**
+   * Obtain a cleared submission queue entry, submitting the queued entries
+   * first if the queue is full.
+   *
+   * \param count number of entries that must fit without submitting in
+   *        between, such as both entries of a linked pair.
+   * \return submission queue entry, submitted on the next call to
+   *         \ref submit_and_wait().
+   * \throws std::system_error on failure to submit the queued entries.
+   */
+  io_uring_sqe&
+  next_sqe(unsigned count = 1);
+
+  /**
+   * Submit the queued entries, and wait for completions.
+   *
+   * \param wait_nr number of completions to wait for. Completions of
+   *        deferred work are only posted when waited for.
+   * \throws std::system_error on failure to enter the ring.
+   */
+  void
+  submit_and_wait(unsigned wait_nr);
+
+  /**
+   * Register a ring of buffers provided for receiving into.
+   *
+   * \param reg buffer ring registration.
+   * \throws std::system_error on failure to register the buffers.
+   */
+  void
+  register_buffer_ring(io_uring_buf_reg& reg);
+
+  /**
+   * Call a function with every completion posted, and consume them.
+   *
+   * \param f function called as \code f(cqe).
+   */
+  template<typename F>
+  void
+  for_each_completion(F&& f)
+  {
+    auto head{*cq_head};
+    auto tail{__atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)};
+    /* Consumed one at a time, so that none is seen twice after a throw */
+    for (; head != tail; head++) {
+      const auto cqe{cqes[head & cq_mask]};
+      __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+      f(cqe);
+    }
+  }
+};
+
+/**
+ * Receives E1.31 packets for a universe, and writes frames to the LEDs,
+ * through one ring, while the \c sd-event loop keeps serving timers,
+ * signals and the other sockets.
+ *
+ * Packets are received by a multishot \c recvmsg() into a provided buffer
+ * ring, and passed to \ref e131_receiver::universe::process_packet(). The
+ * event loop is polled through the same ring, and run whenever it has
+ * events pending. LED frames are written with a linked timeout, one at a
+ * time: frames committed while a write is in flight replace each other,
+ * and the latest is written once the write completes.
+ *
+ * Timers of the event loop changed while processing packets are only
+ * armed when the event loop next runs, so it is run at least every
+ * \ref housekeeping_interval while packets are received.
+ */
+class backend
+{
+public:
+  /**
+   * Source of the LED frames written: encodes the latest output settings,
+   * and returns the buffers sending them, which must stay valid until the
+   * next call.
+   */
+  using frame_source = std::function<const std::vector<iovec>&()>;
+
+  /**
+   * Longest time frames are processed for without running the event loop,
+   * in microseconds.
+   */
+  static constexpr std::uint64_t housekeeping_interval{20000};
+
+  /**
+   * Longest time an LED frame write may take, in microseconds.
+   */
+  static constexpr std::uint64_t output_timeout{100000};
+
+private:
+  /**
+   * Identifiers of the requests submitted, as completion user data.
+   */
+  enum request : std::uint64_t {
+    receive_request = 1,    ///< Multishot recvmsg() on the E1.31 socket
+    event_request,          ///< Multishot poll of the event loop fd
+    output_request,         ///< LED frame write
+    output_timeout_request, ///< Timeout linked to the LED frame write
+    housekeeping_request,   ///< Timeout running the event loop
+  };
+
+  /**
+   * Ancillary data received with a packet: its receive timestamp.
+   */
+  static constexpr std::size_t control_size{CMSG_SPACE(sizeof(timespec))};
+
+  /**
+   * Size of each receive buffer: the \c recvmsg() result header, the
+   * ancillary data and the largest packet processed, rounded up to a cache
+   * line.
+   */
+  static constexpr std::size_t buffer_size{
+      (sizeof(io_uring_recvmsg_out) + control_size +
+       sizeof(e131_receiver::packet_buffer) + 63) /
+      64 * 64};
+
+  /**
+   * Buffer group of the receive buffers.
+   */
+  static constexpr std::uint16_t buffer_group{0};
+
+  e131_receiver::universe& uni;         ///< Universe receiving packets
+  sd_event* ev;                         ///< Event loop polled
+  int e131_socket{-1};                  ///< E1.31 socket fd
+  mapping buf_ring_map{};               ///< Provided buffer ring
+  io_uring_buf_ring* buf_ring{nullptr}; ///< Provided buffer ring tail
+  /**
+   * Provided buffer ring entries. Not io_uring_buf_ring::bufs, which C++
+   * places after an empty member of the flexible array declaration.
+   */
+  io_uring_buf* bufs{nullptr};
+  std::uint16_t buf_tail{0};            ///< Provided buffer ring tail
+  std::uint16_t buf_mask{0};            ///< Provided buffer index mask
+  std::vector<std::uint8_t> buffers;    ///< Receive buffers
+  msghdr rx_header{};                   ///< Receive layout
+  __kernel_timespec write_timeout{};    ///< LED frame write timeout
+  __kernel_timespec tick{};             ///< Housekeeping interval
+  int output_fd{-1};                    ///< LED device fd, or -1
+  frame_source encode{};                ///< Source of LED frames
+  std::size_t output_bytes{0};          ///< Bytes in the frame written
+  bool output_busy{false};              ///< Frame write in flight
+  bool output_pending{false};           ///< Frame committed meanwhile
+  bool housekeeping_armed{false};       ///< Housekeeping timeout queued
+  bool prepared{false};                 ///< Event loop run at least once
+  ring uring;                           ///< Ring, torn down first
+
+  /**
+   * Queue a multishot \c recvmsg() on the E1.31 socket.
+   */
+  void
+  arm_receive();
+
+  /**
+   * Queue a multishot poll of the event loop fd.
+   */
+  void
+  arm_event_poll();
+
+  /**
+   * Queue the write of the latest LED frame, with its timeout.
+   */
+  void
+  submit_output();
+
+  /**
+   * Hand a receive buffer back to the kernel.
+   *
+   * \param bid buffer ID.
+   */
+  void
+  recycle(std::uint16_t bid) noexcept;
+
+  /**
+   * Process a completion of the multishot \c recvmsg().
+   *
+   * \param cqe completion.
+   * \param clocks clock readings taken after the completion was posted.
+   * \retval true a packet was processed.
+   * \retval false no packet was received.
+   * \throws std::system_error on receive errors.
+   */
+  bool
+  receive(const io_uring_cqe& cqe, const e131_receiver::clock_reading& clocks);
+
+  /**
+   * Process the completion of an LED frame write.
+   *
+   * \param cqe completion.
+   * \throws std::system_error on write errors and timeouts.
+   */
+  void
+  output_done(const io_uring_cqe& cqe);
+
+  /**
+   * Run the event loop until it has no events pending, or has finished.
+   *
+   * \throws std::system_error on failure to run the event loop.
+   */
+  void
+  dispatch();
+
+public:
+  /**
+   * Set up the ring, and take over receiving on the E1.31 socket of a
+   * universe from its event loop.
+   *
+   * \param universe universe whose E1.31 socket to receive on.
+   * \param event_loop event loop to poll through the ring.
+   * \param entries ring size, and number of receive buffers, a power of 2
+   *        up to 32768.
+   * \throws std::system_error on failure to set up the ring, in which case
+   *         the universe still receives through its event loop.
+   * \throws std::invalid_argument if the universe opened no socket.
+   */
+  backend(e131_receiver::universe& universe, sd_event* event_loop,
+          unsigned entries = 64);
+  backend(const backend& other)  = delete;
+  backend(const backend&& other) = delete;
+  backend&
+  operator=(const backend& other) = delete;
+  backend&
+  operator=(const backend&& other) = delete;
+
+  /**
+   * Write LED frames through the ring.
+   *
+   * \param fd device to write frames to, such as spidev.
+   * \param source source of the frames written.
+   */
+  void
+  set_output(int fd, frame_source source);
+
+  /**
+   * Write the latest LED frame, once any frame write in flight completes.
+   *
+   * \throws std::system_error on failure to submit the write.
+   */
+  void
+  commit();
+
+  /**
+   * Submit the requests queued, wait for at least one completion, and
+   * process the completions posted.
+   *
+   * Packets received are passed to the universe, whose events are then
+   * obtained with \ref e131_receiver::universe::flush(). Events of the
+   * event loop, including those of the universe, are dispatched.
+   *
+   * \return number of packets received.
+   * \throws std::system_error on receive, output and event loop errors.
+   */
+  std::size_t
+  run();
+};
+} // namespace uring_backend
+
+#endif /* URING_BACKEND_HPP_ */
@@ -0,0 +1,190 @@
+/**
+ * \file bench.hpp
+ *
+ * Benchmark harness: option parsing, timing and registration of the
+ * benchmarks built into e131_bench.
+ *
+ * \sa main.cpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#ifndef BENCH_HPP_
+#define BENCH_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+/**
+ * Options given to a benchmark on the command line, as \code --key=value
+ * or \code --flag.
+ */
+class options
+{
+  std::map<std::string, std::string> values; ///< Option values, by key
+
+public:
+  /**
+   * Parse options.
+   *
+   * \param argc number of arguments.
+   * \param argv arguments, without the program and benchmark names.
+   * \throws std::invalid_argument on arguments that are not options.
+   */
+  options(int argc, char** argv);
+
+  /**
+   * Reject options a benchmark does not take.
+   *
+   * \param known names of the options taken, without the leading dashes.
+   * \throws std::invalid_argument on any other option.
+   */
+  void
+  expect(std::initializer_list<const char*> known) const;
+
+  /**
+   * Obtain the value of an option.
+   *
+   * \param key name of the option, without the leading dashes.
+   * \param fallback value returned if the option was not given.
+   * \return option value.
+   */
+  std::string
+  text(const std::string& key, const std::string& fallback) const;
+
+  /**
+   * Obtain the value of a numeric option.
+   *
+   * \param key name of the option, without the leading dashes.
+   * \param fallback value returned if the option was not given.
+   * \return option value.
+   * \throws std::invalid_argument if the value is not a number.
+   */
+  double
+  number(const std::string& key, double fallback) const;
+
+  /**
+   * Check whether a flag was given.
+   *
+   * \param key name of the flag, without the leading dashes.
+   * \return whether the flag was given.
+   */
+  bool
+  flag(const std::string& key) const
+  {
+    return values.count(key) != 0;
+  }
+};
+
+/**
+ * Benchmark entry point.
+ *
+ * \return exit status of the benchmark.
+ */
+using function = int (*)(const options& opts);
+
+/**
+ * Registered benchmark.
+ */
+struct entry {
+  const char* description; ///< One-line description, listed by --help
+  function run;            ///< Entry point
+};
+
+/**
+ * Obtain the registered benchmarks.
+ *
+ * \return mapping from benchmark name to benchmark.
+ */
+std::map<std::string, entry>&
+registry();
+
+/**
+ * Registers a benchmark when constructed, at static initialization.
+ */
+struct registration {
+  registration(const char* name, const char* description, function run)
+  {
+    registry()[name] = entry{description, run};
+  }
+};
+
+/**
+ * Obtain the time on the monotonic clock.
+ *
+ * \return time in nanoseconds.
+ */
+inline std::uint64_t
+now() noexcept
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (static_cast<std::uint64_t>(ts.tv_sec) * 1000000000) + ts.tv_nsec;
+}
+
+/**
+ * Latency samples, summarized by percentiles.
+ */
+class samples
+{
+  std::vector<std::uint64_t> values; ///< Recorded samples
+
+public:
+  /**
+   * Reserve space for samples, so that recording does not allocate.
+   *
+   * \param count number of samples.
+   */
+  explicit samples(std::size_t count)
+  {
+    values.reserve(count);
+  }
+
+  void
+  add(std::uint64_t value)
+  {
+    values.push_back(value);
+  }
+
+  std::size_t
+  size() const noexcept
+  {
+    return values.size();
+  }
+
+  /**
+   * Obtain a percentile of the samples.
+   *
+   * \param p percentile, from 0 to 100.
+   * \return sample at the percentile, or 0 if there are no samples.
+   */
+  std::uint64_t
+  percentile(double p)
+  {
+    if (values.empty()) return 0;
+    std::size_t i(((values.size() - 1) * p) / 100);
+    std::nth_element(values.begin(), values.begin() + i, values.end());
+    return values[i];
+  }
+
+  /**
+   * Print the median, tail percentiles and maximum of the samples.
+   *
+   * \param name name of the measurement.
+   * \param unit unit of the samples.
+   */
+  void
+  report(const char* name, const char* unit);
+};
+} // namespace bench
+
+#endif /* BENCH_HPP_ */
@@ -0,0 +1,118 @@
+/**
+ * \file daemon.cpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <arpa/inet.h>
+#include <bench.hpp>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <daemon.hpp>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <system_error>
+#include <unistd.h>
+
+namespace bench
+{
+std::string
+sibling_program(const std::string& name)
+{
+  std::string path(PATH_MAX, '\0');
+  auto len{readlink("/proc/self/exe", &path[0], path.size())};
+  if (len < 0) return name;
+  path.resize(len);
+  return path.substr(0, path.rfind('/') + 1) + name;
+}
+
+daemon_process::daemon_process(const std::vector<std::string>& args)
+    : notify{socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0)}
+{
+  if (notify == -1) throw std::system_error{errno, std::system_category()};
+
+  /* Abstract socket address, written as '@name' in NOTIFY_SOCKET */
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  auto name{"e131_bench/" + std::to_string(getpid())};
+  std::memcpy(addr.sun_path + 1, name.data(), name.size());
+  if (bind(notify, reinterpret_cast<sockaddr*>(&addr),
+           offsetof(sockaddr_un, sun_path) + 1 + name.size()) == -1)
+    throw std::system_error{errno, std::system_category()};
+
+  std::vector<char*> argv;
+  for (const auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+  argv.push_back(nullptr);
+
+  start = now();
+  pid   = fork();
+  if (pid == -1) throw std::system_error{errno, std::system_category()};
+  if (pid == 0) {
+    setenv("NOTIFY_SOCKET", ("@" + name).c_str(), 1);
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+}
+
+daemon_process::~daemon_process()
+{
+  if (pid == -1) return;
+  kill(pid, SIGTERM);
+  waitpid(pid, nullptr, 0);
+}
+
+std::uint64_t
+daemon_process::wait_for(const char* text, int timeout_ms,
+                         const std::function<void()>& tick)
+{
+  auto deadline{now() + (timeout_ms * UINT64_C(1000000))};
+  pollfd pfd{notify, POLLIN, 0};
+  while (now() < deadline) {
+    if ((pid != -1) && (waitpid(pid, nullptr, WNOHANG) == pid)) pid = -1;
+    if (pid == -1) throw std::runtime_error{"daemon exited"};
+
+    if (poll(&pfd, 1, 1) <= 0) {
+      if (tick) tick();
+      continue;
+    }
+
+    char msg[4096];
+    auto len{recv(notify, msg, sizeof(msg) - 1, 0)};
+    if (len <= 0) continue;
+    msg[len] = '\0';
+    if (std::strstr(msg, text)) return (now() - start) / 1000;
+  }
+  throw std::runtime_error{std::string{"timed out waiting for "} + text};
+}
+
+loopback_sender::loopback_sender(int universe_num, int port)
+    : fd{socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)},
+      pkt{packet_builder::packet_template}
+{
+  if (fd == -1) throw std::system_error{errno, std::system_category()};
+
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  packet_builder::set_header(pkt, packet_builder::source_cid(0), universe_num,
+                             100, 0);
+  pkt[packet_builder::data_offset] = 0xff;
+}
+
+void
+loopback_sender::send() noexcept
+{
+  sendto(fd, pkt.data(), pkt.size(), 0, reinterpret_cast<sockaddr*>(&addr),
+         sizeof(addr));
+  pkt[packet_builder::sequence_offset]++;
+}
+} // namespace bench
@@ -0,0 +1,116 @@
+/**
+ * \file daemon.hpp
+ *
+ * Daemon started by benchmarks as the service manager would start it, and
+ * E1.31 data sent to it.
+ *
+ * \sa daemon.cpp
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#ifndef DAEMON_HPP_
+#define DAEMON_HPP_
+
+#include <cstdint>
+#include <e131_receiver.hpp>
+#include <functional>
+#include <netinet/in.h>
+#include <packet_builder.hpp>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace bench
+{
+/**
+ * Obtain the path of a program built next to the running benchmark, so
+ * that each variant's benchmark starts that variant's daemon.
+ *
+ * \param name name of the program.
+ * \return path of the program.
+ */
+std::string
+sibling_program(const std::string& name);
+
+/**
+ * Daemon running with a notification socket in \c NOTIFY_SOCKET, stopped
+ * with \c SIGTERM on destruction.
+ */
+class daemon_process
+{
+  e131_receiver::unique_fd notify; ///< Notification socket
+  pid_t pid{-1};                   ///< Process ID, or -1 once reaped
+  std::uint64_t start{0};          ///< Start time, in ns
+
+public:
+  /**
+   * Start the daemon.
+   *
+   * \param args program and arguments.
+   * \throws std::system_error on failure to start the daemon.
+   */
+  explicit daemon_process(const std::vector<std::string>& args);
+  daemon_process(const daemon_process& other)  = delete;
+  daemon_process(const daemon_process&& other) = delete;
+  daemon_process&
+  operator=(const daemon_process& other) = delete;
+  daemon_process&
+  operator=(const daemon_process&& other) = delete;
+  ~daemon_process();
+
+  /**
+   * Wait for the daemon to send a notification containing some text.
+   *
+   * \param text text to wait for, such as \c "READY=1".
+   * \param timeout_ms time to wait, in milliseconds.
+   * \param tick function called every millisecond while waiting.
+   * \return time of the notification, in microseconds since the daemon
+   *         was started.
+   * \throws std::runtime_error if the daemon exits or the wait times out.
+   */
+  std::uint64_t
+  wait_for(const char* text, int timeout_ms,
+           const std::function<void()>& tick = {});
+
+  /**
+   * Obtain the process ID of the daemon.
+   */
+  pid_t
+  id() const noexcept
+  {
+    return pid;
+  }
+};
+
+/**
+ * Sends E1.31 data from a single source to the loopback interface.
+ */
+class loopback_sender
+{
+  e131_receiver::unique_fd fd; ///< Sending socket
+  sockaddr_in addr{};          ///< Daemon address
+  packet_builder::packet pkt;  ///< Packet sent, with its sequence number
+
+public:
+  /**
+   * Open the sending socket.
+   *
+   * \param universe_num universe to send data to.
+   * \param port E1.31 port the daemon listens on.
+   * \throws std::system_error on failure to open the socket.
+   */
+  loopback_sender(int universe_num, int port);
+
+  /**
+   * Send the next packet, ignoring errors, as the daemon may not be
+   * listening yet.
+   */
+  void
+  send() noexcept;
+};
+} // namespace bench
+
+#endif /* DAEMON_HPP_ */
@@ -0,0 +1,130 @@
+/**
+ * \file idle.cpp
+ *
+ * Wakeups per minute of the daemon while no source is active, optionally
+ * with traffic for another universe arriving on the E1.31 port.
+ *
+ * Wakeups are counted as the context switches of the daemon, read from
+ * \c /proc, which is single-threaded.
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <bench.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <daemon.hpp>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+/**
+ * Obtain the number of context switches of a process.
+ */
+unsigned long
+context_switches(pid_t pid)
+{
+  std::ifstream status{"/proc/" + std::to_string(pid) + "/status"};
+  unsigned long total{0};
+  for (std::string line; std::getline(status, line);) {
+    if ((line.compare(0, 24, "voluntary_ctxt_switches:") == 0) ||
+        (line.compare(0, 27, "nonvoluntary_ctxt_switches:") == 0))
+      total += std::stoul(line.substr(line.find(':') + 1));
+  }
+  return total;
+}
+
+/**
+ * Sleep until a time on the monotonic clock.
+ *
+ * \param until time to sleep until, in nanoseconds.
+ */
+void
+sleep_until(std::uint64_t until)
+{
+  timespec ts{static_cast<time_t>(until / 1000000000),
+              static_cast<long>(until % 1000000000)};
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+}
+
+/**
+ * Measure the wakeups of the idle daemon.
+ *
+ * The daemon must be configured for the universe given with --universe,
+ * and nothing else may be bound to the E1.31 port.
+ *
+ * Options:
+ *   --program=FILE  daemon to start [default: e131_blinkt next to this
+ *                   program]
+ *   --config=FILE   configuration file [default: e131_blinkt.conf]
+ *   --spidev=FILE   SPI device [default: /dev/spidev0.0]
+ *   --universe=N    universe the daemon is configured for [default: 1]
+ *   --port=N        E1.31 port [default: 5568]
+ *   --active=S      seconds to send data for before measuring, so that
+ *                   the idle state is entered from a timed out source
+ *                   [default: 3]
+ *   --seconds=S     seconds to measure for [default: 60]
+ *   --foreign=N     packets per second sent to the next universe while
+ *                   measuring [default: 0]
+ */
+int
+idle(const bench::options& opts)
+{
+  opts.expect({"program", "config", "spidev", "universe", "port", "active",
+               "seconds", "foreign"});
+  auto program{opts.text("program", bench::sibling_program("e131_blinkt"))};
+  auto config{opts.text("config", "e131_blinkt.conf")};
+  auto spidev{opts.text("spidev", "/dev/spidev0.0")};
+  int universe_num(opts.number("universe", 1));
+  int port(opts.number("port", 5568));
+  double active{opts.number("active", 3)};
+  double seconds{opts.number("seconds", 60)};
+  double foreign{opts.number("foreign", 0)};
+  if ((seconds <= 0) || (active < 0) || (foreign < 0))
+    throw std::invalid_argument{"invalid duration or rate"};
+
+  constexpr std::uint64_t frame_interval{25000000};
+  bench::loopback_sender sender{universe_num, port};
+  bench::loopback_sender other{universe_num + 1, port};
+  bench::daemon_process daemon{
+      {program, "--config=" + config, "--spidev=" + spidev}};
+  daemon.wait_for("READY=1", 10000);
+
+  if (active > 0) {
+    auto end{bench::now() + static_cast<std::uint64_t>(active * 1e9)};
+    for (auto next{bench::now()}; next < end; next += frame_interval) {
+      sleep_until(next);
+      sender.send();
+    }
+    daemon.wait_for("total: 0)", 10000);
+  }
+
+  auto start{bench::now()};
+  auto end{start + static_cast<std::uint64_t>(seconds * 1e9)};
+  auto before{context_switches(daemon.id())};
+  if (foreign > 0) {
+    auto interval{static_cast<std::uint64_t>(1e9 / foreign)};
+    for (auto next{start}; next < end; next += interval) {
+      sleep_until(next);
+      other.send();
+    }
+  }
+  sleep_until(end);
+  auto wakeups{context_switches(daemon.id()) - before};
+
+  std::printf("idle: %.1f wakeup(s)/min over %.0f s, %.0f foreign "
+              "packet(s)/s\n",
+              wakeups * 60 / seconds, seconds, foreign);
+  return EXIT_SUCCESS;
+}
+
+bench::registration reg{"idle",
+                        "wakeups per minute of the daemon with no source "
+                        "active",
+                        idle};
+} // namespace
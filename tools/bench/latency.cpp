@@ -0,0 +1,311 @@
+/**
+ * \file latency.cpp
+ *
+ * Latency from sending an E1.31 packet to processing its data, and to
+ * committing it to the LEDs when given an SPI device, through the
+ * loopback interface.
+ *
+ * A sender process embeds its send time in the first DMX channels of each
+ * packet, so that the latency of every packet is known on arrival.
+ *
+ * The receiver waits for packets in the event loop, as the daemon does by
+ * default, or with busy polling, or spinning on the socket, so that the
+ * receive modes can be compared.
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <arpa/inet.h>
+#include <bench.hpp>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <e131_receiver.hpp>
+#include <heap_counter.hpp>
+#include <led_strip.hpp>
+#include <malloc.h>
+#include <memory>
+#include <netinet/in.h>
+#include <packet_builder.hpp>
+#include <poll.h>
+#include <sched.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace
+{
+using strip_type = led_strip::strip<led_strip::apa102, 8>;
+
+constexpr int universe_num{1};
+constexpr int e131_port{5568};
+
+/**
+ * Parse a comma-separated list of CPUs.
+ *
+ * \param cpus CPU list.
+ * \return set of the CPUs listed.
+ */
+cpu_set_t
+parse_cpus(const std::string& cpus)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  std::istringstream list{cpus};
+  for (std::string cpu; std::getline(list, cpu, ',');)
+    CPU_SET(std::stoi(cpu), &set);
+  return set;
+}
+
+/**
+ * Move the process to realtime scheduling, as the daemon does with
+ * realtime.enabled.
+ *
+ * \param priority \c SCHED_FIFO priority.
+ * \param cpus CPUs to run on, or none to leave the affinity alone.
+ * \throws std::system_error on failure to change scheduling.
+ */
+void
+enter_realtime(int priority, const cpu_set_t& cpus)
+{
+  if (CPU_COUNT(&cpus) && (sched_setaffinity(0, sizeof(cpus), &cpus) == -1))
+    throw std::system_error{errno, std::system_category()};
+
+  sched_param param{};
+  param.sched_priority = priority;
+  if (sched_setscheduler(0, SCHED_FIFO, &param) == -1)
+    throw std::system_error{errno, std::system_category()};
+
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+    throw std::system_error{errno, std::system_category()};
+}
+
+/**
+ * Send packets to the loopback interface at a fixed rate, each carrying
+ * its send time, then exit.
+ *
+ * \param cpus CPUs to move to, away from the receiver, or none to stay on
+ *        the CPUs of the receiver.
+ */
+[[noreturn]] void
+run_sender(long packets, long rate, const cpu_set_t& cpus)
+{
+  if (CPU_COUNT(&cpus)) sched_setaffinity(0, sizeof(cpus), &cpus);
+
+  int fd{socket(AF_INET, SOCK_DGRAM, 0)};
+  if (fd == -1) _exit(EXIT_FAILURE);
+
+  sockaddr_in addr{};
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons(e131_port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  auto pkt{packet_builder::packet_template};
+  packet_builder::set_header(pkt, packet_builder::source_cid(0), universe_num,
+                             100, 0);
+
+  timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for (long i{0}; i < packets; i++) {
+    next.tv_nsec += 1000000000 / rate;
+    if (next.tv_nsec >= 1000000000) {
+      next.tv_sec++;
+      next.tv_nsec -= 1000000000;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+
+    pkt[packet_builder::sequence_offset] = static_cast<std::uint8_t>(i);
+    auto sent{bench::now()};
+    std::memcpy(pkt.data() + packet_builder::data_offset, &sent,
+                sizeof(sent));
+    sendto(fd, pkt.data(), pkt.size(), 0, reinterpret_cast<sockaddr*>(&addr),
+           sizeof(addr));
+  }
+  _exit(EXIT_SUCCESS);
+}
+
+/**
+ * How the receiver waits for packets.
+ */
+enum class receive_mode {
+  epoll,     ///< Sleeping in the event loop, as the daemon does by default
+  busy_poll, ///< Sleeping in the event loop, with busy polling enabled
+  spin,      ///< Spinning on the socket, as with busy_poll.spin
+};
+
+/**
+ * Measure the latency of packets received in one mode.
+ *
+ * \param name name of the mode.
+ * \param mode receive mode.
+ * \param opts benchmark options.
+ * \param strip LEDs to commit each frame to, or \c nullptr.
+ * \param sender_cpus CPUs to run the sender on.
+ */
+void
+measure(const char* name, receive_mode mode, const bench::options& opts,
+        strip_type* strip, const cpu_set_t& sender_cpus)
+{
+  long packets(opts.number("packets", 10000));
+  long rate(opts.number("rate", 1000));
+  e131_receiver::universe uni{1, false, universe_num, true};
+  if (mode == receive_mode::busy_poll)
+    uni.enable_busy_poll(opts.number("busy-poll", 50), opts.flag("prefer"));
+  bench::samples latencies(packets);
+
+  /* One more packet than measured, as the first one adds the source */
+  pid_t sender{fork()};
+  if (sender == -1) throw std::system_error{errno, std::system_category()};
+  if (sender == 0) run_sender(packets + 1, rate, sender_cpus);
+
+  rusage usage{};
+  long faults{0};
+  unsigned long allocations{0};
+  bool started{false};
+  pollfd pfd{uni.event_fd(), POLLIN, 0};
+  while (latencies.size() < static_cast<std::size_t>(packets)) {
+    /* Packets lost on the way are not waited for */
+    if (mode == receive_mode::spin) {
+      auto deadline{bench::now() + 1000000000};
+      while (!uni.receive() && (bench::now() < deadline))
+        ;
+      if (bench::now() >= deadline) break;
+    } else if (poll(&pfd, 1, 1000) == 0) {
+      break;
+    }
+
+    for (const auto& e : uni.update()) {
+      if (e.event != e131_receiver::update_event::CHANNEL_DATA_UPDATED)
+        continue;
+
+      const auto& data{uni.dmx_data()};
+      if (strip) {
+        for (std::size_t i{0}; i < strip->size(); i++)
+          strip->set(i, strip_type::chip_type::make_pixel(
+                            0x1f, data[i * 3], data[(i * 3) + 1],
+                            data[(i * 3) + 2]));
+        strip->commit();
+      }
+
+      std::uint64_t sent;
+      std::memcpy(&sent, data.data(), sizeof(sent));
+      auto done{bench::now()};
+      if (started) {
+        latencies.add(done - sent);
+      } else {
+        getrusage(RUSAGE_SELF, &usage);
+        faults      = usage.ru_minflt;
+        allocations = heap_counter::allocations();
+        started     = true;
+      }
+    }
+  }
+
+  getrusage(RUSAGE_SELF, &usage);
+  faults      = usage.ru_minflt - faults;
+  allocations = heap_counter::allocations() - allocations;
+  kill(sender, SIGTERM);
+  waitpid(sender, nullptr, 0);
+
+  std::string title{std::string{"latency ("} + name + "): send to " +
+                    (strip ? "commit" : "data")};
+  latencies.report(title.c_str(), "ns");
+  std::printf("latency (%s): %ld packet(s) lost, %ld page fault(s), %lu "
+              "heap allocation(s) after the first packet\n",
+              name, packets - static_cast<long>(latencies.size()), faults,
+              allocations);
+}
+
+/**
+ * Measure the latency of packets sent through the loopback interface, in
+ * each receive mode given.
+ *
+ * The receiver binds the E1.31 port with SO_REUSEPORT, so stop any daemon
+ * on the same host that does not, or that would take the packets.
+ *
+ * Options:
+ *   --packets=N    packets measured per mode [default: 10000]
+ *   --rate=N       packets sent per second [default: 1000]
+ *   --modes=LIST   comma-separated receive modes to compare, of 'epoll',
+ *                  'busy-poll' and 'spin' [default: epoll]
+ *   --busy-poll=U  busy polling time in microseconds, for busy-poll
+ *                  [default: 50]
+ *   --prefer       prefer busy polling over interrupts, for busy-poll
+ *   --spidev=FILE  SPI device to commit each frame to, as the daemon does
+ *   --realtime=P   run at SCHED_FIFO priority P with memory locked
+ *   --cpus=LIST    comma-separated CPUs to run on, with --realtime. The
+ *                  sender runs on the other CPUs, if any.
+ */
+int
+latency(const bench::options& opts)
+{
+  opts.expect({"packets", "rate", "modes", "busy-poll", "prefer", "spidev",
+               "realtime", "cpus"});
+  long packets(opts.number("packets", 10000));
+  long rate(opts.number("rate", 1000));
+  auto spidev{opts.text("spidev", "")};
+  if ((packets < 1) || (rate < 1) || (rate > 1000000))
+    throw std::invalid_argument{"invalid packet count or rate"};
+
+  std::vector<std::pair<std::string, receive_mode>> modes;
+  std::istringstream list{opts.text("modes", "epoll")};
+  for (std::string mode; std::getline(list, mode, ',');) {
+    if (mode == "epoll")
+      modes.emplace_back(mode, receive_mode::epoll);
+    else if (mode == "busy-poll")
+      modes.emplace_back(mode, receive_mode::busy_poll);
+    else if (mode == "spin")
+      modes.emplace_back(mode, receive_mode::spin);
+    else
+      throw std::invalid_argument{"unknown receive mode " + mode};
+  }
+
+  std::unique_ptr<strip_type> strip;
+  if (!spidev.empty()) strip = std::make_unique<strip_type>(spidev);
+
+  cpu_set_t sender_cpus;
+  CPU_ZERO(&sender_cpus);
+  if (opts.flag("realtime")) {
+    auto cpus{parse_cpus(opts.text("cpus", ""))};
+    if (CPU_COUNT(&cpus)) {
+      cpu_set_t allowed;
+      if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+        throw std::system_error{errno, std::system_category()};
+      for (int cpu{0}; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &allowed) && !CPU_ISSET(cpu, &cpus))
+          CPU_SET(cpu, &sender_cpus);
+    }
+
+    /* As in the daemon, a spinning realtime receiver starves its core */
+    for (const auto& mode : modes) {
+      if ((mode.second == receive_mode::spin) && !CPU_COUNT(&sender_cpus))
+        throw std::invalid_argument{"spinning with --realtime requires "
+                                    "--cpus leaving a core free"};
+    }
+    enter_realtime(opts.number("realtime", 0), cpus);
+  }
+
+  for (const auto& mode : modes)
+    measure(mode.first.c_str(), mode.second, opts, strip.get(), sender_cpus);
+  return EXIT_SUCCESS;
+}
+
+bench::registration reg{"latency",
+                        "latency from sending a packet to processing or "
+                        "committing it",
+                        latency};
+} // namespace
@@ -0,0 +1,120 @@
+/**
+ * \file main.cpp
+ *
+ * Entry point of e131_bench, which runs a benchmark of the receiver and
+ * output driver chosen on the command line.
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <bench.hpp>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <stdexcept>
+
+namespace bench
+{
+options::options(int argc, char** argv)
+{
+  for (int i{0}; i < argc; i++) {
+    std::string arg{argv[i]};
+    if (arg.compare(0, 2, "--") != 0)
+      throw std::invalid_argument{"unexpected argument " + arg};
+
+    auto equals{arg.find('=')};
+    if (equals == std::string::npos)
+      values[arg.substr(2)] = "";
+    else
+      values[arg.substr(2, equals - 2)] = arg.substr(equals + 1);
+  }
+}
+
+void
+options::expect(std::initializer_list<const char*> known) const
+{
+  for (const auto& v : values) {
+    if (std::none_of(known.begin(), known.end(),
+                     [&v](const char* k) { return v.first == k; }))
+      throw std::invalid_argument{"unknown option --" + v.first};
+  }
+}
+
+std::string
+options::text(const std::string& key, const std::string& fallback) const
+{
+  auto it{values.find(key)};
+  return (it == values.end()) ? fallback : it->second;
+}
+
+double
+options::number(const std::string& key, double fallback) const
+{
+  auto it{values.find(key)};
+  if (it == values.end()) return fallback;
+
+  std::size_t end;
+  double value;
+  try {
+    value = std::stod(it->second, &end);
+  } catch (const std::exception&) {
+    end = 0;
+  }
+  if ((end == 0) || (end != it->second.size()))
+    throw std::invalid_argument{"--" + key + " requires a number"};
+  return value;
+}
+
+std::map<std::string, entry>&
+registry()
+{
+  static std::map<std::string, entry> benchmarks;
+  return benchmarks;
+}
+
+void
+samples::report(const char* name, const char* unit)
+{
+  std::printf("%s (%zu samples): median %" PRIu64 " %s, 99%% %" PRIu64
+              " %s, 99.9%% %" PRIu64 " %s, max %" PRIu64 " %s\n",
+              name, size(), percentile(50), unit, percentile(99), unit,
+              percentile(99.9), unit, percentile(100), unit);
+}
+} // namespace bench
+
+namespace
+{
+void
+usage(const char* program)
+{
+  std::printf("Usage: %s <benchmark> [--option=value...]\n\nBenchmarks:\n",
+              program);
+  for (const auto& b : bench::registry())
+    std::printf("  %-16s %s\n", b.first.c_str(), b.second.description);
+}
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+  if (argc < 2) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  auto it{bench::registry().find(argv[1])};
+  if (it == bench::registry().end()) {
+    usage(argv[0]);
+    return std::string{argv[1]} == "--help" ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  try {
+    return it->second.run(bench::options{argc - 2, argv + 2});
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "%s: %s\n", argv[1], e.what());
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,121 @@
+/**
+ * \file monitor.cpp
+ *
+ * Packets per second tracked by the all-universe monitor, and its memory
+ * use, for increasing numbers of active universes.
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <bench.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <deleters.hpp>
+#include <e131_monitor.hpp>
+#include <malloc.h>
+#include <memory>
+#include <packet_builder.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+/**
+ * Obtain the number of bytes allocated from the heap.
+ */
+std::size_t
+heap_in_use()
+{
+#if __GLIBC_PREREQ(2, 33)
+  return mallinfo2().uordblks;
+#else
+  return static_cast<unsigned int>(mallinfo().uordblks);
+#endif
+}
+
+/**
+ * Send packets round-robin to a number of universes, and report the rate
+ * they are tracked at and the memory used to track them.
+ */
+void
+measure(int universes, int sources, long packets)
+{
+  int r;
+  sd_event* evp;
+  if ((r = sd_event_new(&evp)) < 0)
+    throw std::system_error{-r, std::system_category()};
+  std::unique_ptr<sd_event, deleters::sd_event> ev{evp};
+
+  auto heap_before{heap_in_use()};
+  e131_monitor::monitor mon{e131_receiver::no_socket, ev.get(), sources};
+
+  /* One packet per source, rewritten with its universe on every round */
+  std::vector<packet_builder::packet> pkts(sources,
+                                           packet_builder::packet_template);
+  for (int i{0}; i < sources; i++)
+    packet_builder::set_header(pkts[i], packet_builder::source_cid(i), 1, 100,
+                               0);
+
+  std::uint64_t start{0};
+  long streams(universes * sources);
+  for (long i{0}; i < (packets + streams); i++) {
+    /* The first packet of each stream activates it, and is not timed */
+    if (i == streams) start = bench::now();
+
+    auto& pkt{pkts[i % sources]};
+    int universe_num(1 + ((i / sources) % universes));
+    pkt[packet_builder::universe_offset]     = universe_num >> 8;
+    pkt[packet_builder::universe_offset + 1] = universe_num;
+    pkt[packet_builder::sequence_offset] = static_cast<std::uint8_t>(
+        i / streams);
+    mon.process_packet(pkt.data(), pkt.size(), bench::now() / 1000);
+
+    /* Lets the sweep run, as it would between receive batches */
+    if ((i % 64) == 0) sd_event_run(ev.get(), 0);
+  }
+
+  double rate{packets * 1e9 / (bench::now() - start)};
+  std::printf("monitor: %6zu universe(s), %2d source(s) each: %9.0f "
+              "packets/s, %8zu bytes of heap\n",
+              mon.active_universes(), sources, rate,
+              heap_in_use() - heap_before);
+}
+
+/**
+ * Measure the monitor with each number of universes given.
+ *
+ * Options:
+ *   --universes=LIST  comma-separated numbers of active universes
+ *                     [default: 1,16,256,4096,63999]
+ *   --sources=N       sources sending to each universe [default: 1]
+ *   --packets=N       packets timed for each number of universes
+ *                     [default: 1000000]
+ */
+int
+monitor(const bench::options& opts)
+{
+  opts.expect({"universes", "sources", "packets"});
+  std::istringstream list{opts.text("universes", "1,16,256,4096,63999")};
+  int sources(opts.number("sources", 1));
+  long packets(opts.number("packets", 1000000));
+  if ((sources < 1) || (packets < 1))
+    throw std::invalid_argument{"counts must be positive"};
+
+  for (std::string universes; std::getline(list, universes, ',');) {
+    int count{std::stoi(universes)};
+    if ((count < 1) || (count > 63999))
+      throw std::invalid_argument{"universe counts must be from 1 to 63999"};
+    measure(count, sources, packets);
+  }
+  return EXIT_SUCCESS;
+}
+
+bench::registration reg{"monitor",
+                        "packets/s and memory of the all-universe monitor",
+                        monitor};
+} // namespace
@@ -0,0 +1,165 @@
+/**
+ * \file parser.cpp
+ *
+ * Time taken to validate and decode an E1.31 data packet with
+ * \ref e131_receiver::packet_view, and with libe131 when it is installed,
+ * on valid and malformed packets.
+ *
+ * The libe131 path is the one the receiver took before: the packet is
+ * copied into an \c e131_packet_t, as \c e131_recv() does, validated with
+ * \c e131_pkt_validate(), and its fields byte-swapped as they are read.
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <bench.hpp>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <e131_packet.hpp>
+#include <endian.h>
+#include <packet_builder.hpp>
+#include <stdexcept>
+#include <vector>
+
+#ifdef HAVE_LIBE131
+#include <e131.h>
+#endif
+
+namespace
+{
+constexpr int universe_num{1};
+
+/**
+ * Packet to parse, and its length.
+ */
+struct input {
+  const char* name;           ///< What is wrong with the packet
+  packet_builder::packet pkt; ///< Packet contents
+  std::size_t len;            ///< Length of the packet
+};
+
+/**
+ * Build a valid packet, and packets rejected at different points of
+ * validation.
+ */
+std::vector<input>
+make_inputs()
+{
+  auto pkt{packet_builder::packet_template};
+  packet_builder::set_header(pkt, packet_builder::source_cid(0), universe_num,
+                             100, 0);
+  std::vector<input> inputs(5, input{"valid", pkt, pkt.size()});
+
+  inputs[1].name = "truncated";
+  inputs[1].len  = packet_builder::data_offset - 1;
+  inputs[2].name = "bad preamble";
+  inputs[2].pkt[4] ^= 0xff;
+  inputs[3].name = "bad vector";
+  inputs[3].pkt[43] ^= 0xff;
+  inputs[4].name = "bad count";
+  inputs[4].len  = pkt.size() - 1;
+  return inputs;
+}
+
+/**
+ * Validate and decode a packet with \ref e131_receiver::packet_view, as
+ * the receiver does.
+ *
+ * \return sum of the decoded fields, or 0 if the packet is rejected.
+ */
+unsigned int
+parse_view(const std::uint8_t* buf, std::size_t len)
+{
+  e131_receiver::packet_view view{buf, len};
+  if (!view.valid() || (view.universe() != universe_num) || view.preview())
+    return 0;
+  return view.cid_data()[0] + view.priority() + view.sequence() +
+         view.terminated() + view.start_code() + view.data()[0] + view.count();
+}
+
+#ifdef HAVE_LIBE131
+/**
+ * Validate and decode a packet with libe131, as the receiver did.
+ *
+ * \return sum of the decoded fields, or 0 if the packet is rejected.
+ */
+unsigned int
+parse_libe131(const std::uint8_t* buf, std::size_t len)
+{
+  constexpr std::size_t header_size{offsetof(e131_packet_t, dmp.prop_val)};
+  e131_packet_t pkt;
+  std::memcpy(&pkt, buf, std::min(len, sizeof(pkt)));
+
+  /* Reject truncated packets, which leave stale data in the buffer */
+  if ((len < header_size) || !pkt.dmp.prop_val_cnt ||
+      (be16toh(pkt.dmp.prop_val_cnt) > sizeof(pkt.dmp.prop_val)) ||
+      (be16toh(pkt.dmp.prop_val_cnt) > (len - header_size)))
+    return 0;
+
+  if ((e131_pkt_validate(&pkt) != E131_ERR_NONE) ||
+      (be32toh(pkt.root.vector) != 0x00000004) ||
+      (be16toh(pkt.frame.universe) != universe_num) ||
+      e131_get_option(&pkt, E131_OPT_PREVIEW))
+    return 0;
+  return pkt.root.cid[0] + pkt.frame.priority + pkt.frame.seq_number +
+         e131_get_option(&pkt, E131_OPT_TERMINATED) + pkt.dmp.prop_val[0] +
+         pkt.dmp.prop_val[1] + (be16toh(pkt.dmp.prop_val_cnt) - 1);
+}
+#endif
+
+/**
+ * Time a parser over a packet.
+ *
+ * \return nanoseconds per packet.
+ */
+template<typename F>
+double
+time_parser(F&& parse, const input& in, long packets)
+{
+  volatile unsigned int sink{0};
+  auto start{bench::now()};
+  for (long i{0}; i < packets; i++) {
+    /* Defeats hoisting the parse out of the loop */
+    asm volatile("" : : "r"(in.pkt.data()) : "memory");
+    sink = sink + parse(in.pkt.data(), in.len);
+  }
+  return static_cast<double>(bench::now() - start) / packets;
+}
+
+/**
+ * Compare the time taken to validate and decode packets.
+ *
+ * Options:
+ *   --packets=N  packets parsed per input and parser [default: 10000000]
+ */
+int
+parser(const bench::options& opts)
+{
+  opts.expect({"packets"});
+  long packets(opts.number("packets", 10000000));
+  if (packets < 1) throw std::invalid_argument{"--packets must be positive"};
+
+  for (const auto& in : make_inputs()) {
+    std::printf("parser: %-12s packet_view %6.1f ns/packet", in.name,
+                time_parser(parse_view, in, packets));
+#ifdef HAVE_LIBE131
+    std::printf(", libe131 %6.1f ns/packet",
+                time_parser(parse_libe131, in, packets));
+#endif
+    std::printf("\n");
+  }
+#ifndef HAVE_LIBE131
+  std::printf("parser: libe131 not found at build time, not compared\n");
+#endif
+  return EXIT_SUCCESS;
+}
+
+bench::registration reg{"parser",
+                        "ns/packet to validate and decode E1.31 packets, "
+                        "against libe131",
+                        parser};
+} // namespace
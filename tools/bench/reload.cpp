@@ -0,0 +1,98 @@
+/**
+ * \file reload.cpp
+ *
+ * Check that changing the universe on a configuration reload releases the
+ * sources of the old universe: the daemon blanks the LEDs and goes idle,
+ * as it does when its sources time out.
+ *
+ * The daemon is started on a copy of the configuration file, and sent data
+ * until it reports an output source. The copy is then changed to the next
+ * universe and the daemon sent SIGHUP, while data for the old universe is
+ * still sent.
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <bench.hpp>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <daemon.hpp>
+#include <libconfig.h++>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+namespace
+{
+/**
+ * Check the release of the sources on a universe change.
+ *
+ * The daemon must be configured for the universe given with --universe,
+ * and nothing else may be bound to the E1.31 port.
+ *
+ * Options:
+ *   --program=FILE  daemon to start [default: e131_blinkt next to this
+ *                   program]
+ *   --config=FILE   configuration file [default: e131_blinkt.conf]
+ *   --spidev=FILE   SPI device [default: /dev/spidev0.0]
+ *   --universe=N    universe the daemon is configured for [default: 1]
+ *   --port=N        E1.31 port [default: 5568]
+ *   --timeout=MS    time to wait for each step [default: 10000]
+ */
+int
+reload(const bench::options& opts)
+{
+  opts.expect({"program", "config", "spidev", "universe", "port", "timeout"});
+  auto program{opts.text("program", bench::sibling_program("e131_blinkt"))};
+  auto config{opts.text("config", "e131_blinkt.conf")};
+  auto spidev{opts.text("spidev", "/dev/spidev0.0")};
+  int universe_num(opts.number("universe", 1));
+  int port(opts.number("port", 5568));
+  int timeout_ms(opts.number("timeout", 10000));
+  if ((universe_num < 1) || (universe_num >= 63999))
+    throw std::invalid_argument{"invalid universe"};
+
+  /* Written back without comments, which the daemon does not need */
+  libconfig::Config settings{};
+  settings.readFile(config.c_str());
+  auto copy{"/tmp/e131_bench_reload." + std::to_string(getpid()) + ".conf"};
+  settings.writeFile(copy.c_str());
+
+  try {
+    bench::loopback_sender sender{universe_num, port};
+    bench::daemon_process daemon{
+        {program, "--config=" + copy, "--spidev=" + spidev}};
+    daemon.wait_for("READY=1", timeout_ms);
+    daemon.wait_for("STATUS=1 output source", timeout_ms,
+                    [&sender] { sender.send(); });
+
+    settings.lookup("e131_blinkt.e131.universe") = universe_num + 1;
+    settings.writeFile(copy.c_str());
+    auto start{bench::now()};
+    kill(daemon.id(), SIGHUP);
+
+    /* Data for the old universe keeps coming, and must not keep it active */
+    daemon.wait_for("STATUS=Awaiting data sources, LEDs blanked.", timeout_ms,
+                    [&sender] { sender.send(); });
+    auto blanked{bench::now()};
+    daemon.wait_for("READY=1", timeout_ms, [&sender] { sender.send(); });
+
+    std::printf("reload: LEDs blanked and idle %.3f ms after SIGHUP, "
+                "universe %d to %d\n",
+                (blanked - start) / 1e6, universe_num, universe_num + 1);
+  } catch (...) {
+    unlink(copy.c_str());
+    throw;
+  }
+  unlink(copy.c_str());
+  return EXIT_SUCCESS;
+}
+
+bench::registration reg{"reload",
+                        "check that a universe change on reload blanks the "
+                        "LEDs and goes idle",
+                        reload};
+} // namespace
@@ -0,0 +1,80 @@
+/**
+ * \file startup.cpp
+ *
+ * Time taken by the daemon to signal readiness to the service manager, and
+ * to display the first frame sent to it, from the moment it is started.
+ *
+ * The daemon is started as the service manager would, with a notification
+ * socket in \c NOTIFY_SOCKET. E1.31 data is sent to it once it is ready,
+ * until it reports an output source in its status, which it does once the
+ * first frame is displayed.
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <bench.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <daemon.hpp>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+/**
+ * Measure the startup time of the daemon.
+ *
+ * The daemon must be configured for the universe given with --universe,
+ * and nothing else may be bound to the E1.31 port.
+ *
+ * Options:
+ *   --program=FILE  daemon to start [default: e131_blinkt next to this
+ *                   program]
+ *   --config=FILE   configuration file [default: e131_blinkt.conf]
+ *   --spidev=FILE   SPI device [default: /dev/spidev0.0]
+ *   --universe=N    universe the daemon is configured for [default: 1]
+ *   --port=N        E1.31 port [default: 5568]
+ *   --runs=N        number of starts [default: 10]
+ *   --timeout=MS    time to wait for a frame to be displayed
+ *                   [default: 10000]
+ */
+int
+startup(const bench::options& opts)
+{
+  opts.expect({"program", "config", "spidev", "universe", "port", "runs",
+               "timeout"});
+  auto program{opts.text("program", bench::sibling_program("e131_blinkt"))};
+  auto config{opts.text("config", "e131_blinkt.conf")};
+  auto spidev{opts.text("spidev", "/dev/spidev0.0")};
+  int universe_num(opts.number("universe", 1));
+  int port(opts.number("port", 5568));
+  int runs(opts.number("runs", 10));
+  int timeout_ms(opts.number("timeout", 10000));
+  if (runs < 1) throw std::invalid_argument{"--runs must be positive"};
+
+  bench::samples ready(runs);
+  bench::samples frame(runs);
+  for (int i{0}; i < runs; i++) {
+    bench::loopback_sender sender{universe_num, port};
+    bench::daemon_process daemon{
+        {program, "--config=" + config, "--spidev=" + spidev}};
+
+    /* Data is sent every millisecond once ready, until a frame is shown */
+    ready.add(daemon.wait_for("READY=1", timeout_ms));
+    frame.add(daemon.wait_for("STATUS=1 output source", timeout_ms,
+                              [&sender] { sender.send(); }));
+  }
+
+  std::printf("startup: %s\n", program.c_str());
+  ready.report("startup: ready", "us");
+  frame.report("startup: first frame", "us");
+  return EXIT_SUCCESS;
+}
+
+bench::registration reg{"startup",
+                        "time from starting the daemon to READY=1 and to "
+                        "its first frame",
+                        startup};
+} // namespace
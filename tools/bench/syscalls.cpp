@@ -0,0 +1,384 @@
+/**
+ * \file syscalls.cpp
+ *
+ * System calls made per frame received and written to the LEDs, by the
+ * sd-event receive path and by the io_uring backend.
+ *
+ * System calls are counted by the \c raw_syscalls:sys_enter tracepoint,
+ * through a perf counter bound to the receiving thread, which requires
+ * root or \c kernel.perf_event_paranoid set to -1. Frames are sent by
+ * another process through the loopback interface.
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <arpa/inet.h>
+#include <bench.hpp>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <deleters.hpp>
+#include <e131_receiver.hpp>
+#include <fcntl.h>
+#include <fstream>
+#include <led_strip.hpp>
+#include <linux/perf_event.h>
+#include <memory>
+#include <netinet/in.h>
+#include <packet_builder.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <system_error>
+#include <unistd.h>
+#include <uring_backend.hpp>
+#include <vector>
+
+namespace
+{
+using strip_type = led_strip::strip<led_strip::apa102, 8>;
+
+constexpr int universe_num{1};
+constexpr int e131_port{5568};
+
+/**
+ * Counts the system calls entered by the calling thread.
+ */
+class syscall_counter
+{
+  e131_receiver::unique_fd fd; ///< perf event fd
+
+  /**
+   * Obtain the ID of the \c raw_syscalls:sys_enter tracepoint.
+   */
+  static std::uint64_t
+  tracepoint_id()
+  {
+    for (const auto* tracefs : {"/sys/kernel/tracing",
+                                "/sys/kernel/debug/tracing"}) {
+      std::ifstream id_file{std::string{tracefs} +
+                            "/events/raw_syscalls/sys_enter/id"};
+      std::uint64_t id;
+      if (id_file >> id) return id;
+    }
+    throw std::runtime_error{"raw_syscalls:sys_enter tracepoint not found, "
+                             "is tracefs mounted?"};
+  }
+
+public:
+  /**
+   * Start counting.
+   *
+   * \throws std::system_error if the counter cannot be opened.
+   */
+  syscall_counter()
+  {
+    perf_event_attr attr{};
+    attr.type          = PERF_TYPE_TRACEPOINT;
+    attr.size          = sizeof(attr);
+    attr.config        = tracepoint_id();
+    attr.sample_period = 1;
+    fd.reset(static_cast<int>(
+        syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC)));
+    if (fd == -1) throw std::system_error{errno, std::system_category()};
+  }
+
+  /**
+   * Obtain the number of system calls entered so far, including the one
+   * reading the counter.
+   */
+  std::uint64_t
+  read() const
+  {
+    std::uint64_t count;
+    if (::read(fd, &count, sizeof(count)) != sizeof(count))
+      throw std::system_error{errno, std::system_category()};
+    return count;
+  }
+};
+
+/**
+ * Send packets to the loopback interface at a fixed rate, with data
+ * changing on every packet, then exit.
+ */
+[[noreturn]] void
+run_sender(long packets, long rate)
+{
+  int fd{socket(AF_INET, SOCK_DGRAM, 0)};
+  if (fd == -1) _exit(EXIT_FAILURE);
+
+  sockaddr_in addr{};
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons(e131_port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  auto pkt{packet_builder::packet_template};
+  packet_builder::set_header(pkt, packet_builder::source_cid(0), universe_num,
+                             100, 0);
+
+  timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for (long i{0}; i < packets; i++) {
+    next.tv_nsec += 1000000000 / rate;
+    if (next.tv_nsec >= 1000000000) {
+      next.tv_sec++;
+      next.tv_nsec -= 1000000000;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr);
+
+    pkt[packet_builder::sequence_offset] = static_cast<std::uint8_t>(i);
+    pkt[packet_builder::data_offset]     = static_cast<std::uint8_t>(i);
+    sendto(fd, pkt.data(), pkt.size(), 0, reinterpret_cast<sockaddr*>(&addr),
+           sizeof(addr));
+  }
+  _exit(EXIT_SUCCESS);
+}
+
+/**
+ * Receive path measured.
+ */
+enum class backend_type {
+  sd_event, ///< Nested sd-event loops, as the daemon does by default
+  io_uring, ///< io_uring backend, as with io_uring.enabled
+};
+
+/**
+ * Receiver of the frames sent, writing each to the LEDs, or to
+ * \c /dev/null without an SPI device.
+ */
+struct receiver {
+  syscall_counter counter{};          ///< System calls of this thread
+  e131_receiver::universe uni{1, false, universe_num, true}; ///< Universe
+  strip_type* strip;                  ///< LEDs, or \c nullptr
+  e131_receiver::unique_fd null_fd;   ///< /dev/null, without LEDs
+  std::vector<std::uint8_t> frame;    ///< Frame written to /dev/null
+  std::vector<iovec> frame_iov;       ///< Frame written to /dev/null
+  std::unique_ptr<uring_backend::backend> uring{}; ///< io_uring backend
+  long frames{0};                     ///< Frames written
+  long checked{0};                    ///< Frames at the last progress check
+  std::uint64_t start{0};             ///< System calls at the first frame
+
+  /**
+   * Start receiving.
+   *
+   * \param leds LEDs to write frames to, or \c nullptr.
+   * \throws std::system_error on failure to open the receiving socket,
+   *         the counter or \c /dev/null.
+   */
+  explicit receiver(strip_type* leds)
+      : strip{leds}, null_fd{open("/dev/null", O_WRONLY | O_CLOEXEC)},
+        frame(strip_type::frame_size),
+        frame_iov{iovec{frame.data(), frame.size()}}
+  {
+    if (null_fd == -1) throw std::system_error{errno, std::system_category()};
+  }
+
+  /**
+   * Write the DMX data received, as the daemon does.
+   */
+  void
+  output()
+  {
+    const auto& data{uni.dmx_data()};
+    if (strip) {
+      for (std::size_t i{0}; i < strip->size(); i++)
+        strip->set(i, strip_type::chip_type::make_pixel(
+                          0x1f, data[i * 3], data[(i * 3) + 1],
+                          data[(i * 3) + 2]));
+    } else {
+      frame[strip_type::chip_type::start_frame_size] = data[0];
+    }
+
+    if (uring)
+      uring->commit();
+    else if (strip)
+      strip->commit();
+    else if (write(null_fd, frame.data(), frame.size()) == -1)
+      throw std::system_error{errno, std::system_category()};
+  }
+
+  /**
+   * Write the frames among the events of the universe.
+   *
+   * \param events events of the universe.
+   */
+  void
+  process(const std::vector<e131_receiver::update_event>& events)
+  {
+    for (const auto& e : events) {
+      if (e.event != e131_receiver::update_event::CHANNEL_DATA_UPDATED)
+        continue;
+      output();
+      /* The first frame adds the source, and is not counted */
+      if (!frames++) start = counter.read();
+    }
+  }
+
+  /**
+   * Process the events of the universe, when the sd-event loop signals
+   * them.
+   */
+  static int
+  universe_callback(sd_event_source* s, int fd, std::uint32_t revents,
+                    void* userdata) noexcept
+  {
+    auto& rx{*static_cast<receiver*>(userdata)};
+    try {
+      rx.process(rx.uni.update());
+    } catch (const std::exception& e) {
+      std::fprintf(stderr, "syscalls: %s\n", e.what());
+      sd_event_exit(sd_event_source_get_event(s), EXIT_FAILURE);
+    }
+    return 0;
+  }
+
+  /**
+   * Stop once no frame arrived for a second, as packets may be lost.
+   */
+  static int
+  progress_callback(sd_event_source* s, std::uint64_t usec,
+                    void* userdata) noexcept
+  {
+    auto& rx{*static_cast<receiver*>(userdata)};
+    if (rx.frames == rx.checked) {
+      sd_event_exit(sd_event_source_get_event(s), EXIT_SUCCESS);
+      return 0;
+    }
+    rx.checked = rx.frames;
+    sd_event_source_set_time(s, usec + 1000000);
+    sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+    return 0;
+  }
+};
+
+/**
+ * Count the system calls made per frame through one receive path.
+ *
+ * \param name name of the receive path.
+ * \param type receive path.
+ * \param opts benchmark options.
+ * \param strip LEDs to write each frame to, or \c nullptr.
+ */
+void
+measure(const char* name, backend_type type, const bench::options& opts,
+        strip_type* strip)
+{
+  long packets(opts.number("packets", 10000));
+  long rate(opts.number("rate", 1000));
+
+  int r;
+  sd_event* evp;
+  if ((r = sd_event_new(&evp)) < 0)
+    throw std::system_error{-r, std::system_category()};
+  std::unique_ptr<sd_event, deleters::sd_event> ev{evp};
+
+  receiver rx{strip};
+  std::uint64_t now_usec;
+  sd_event_now(ev.get(), CLOCK_MONOTONIC, &now_usec);
+  if ((r = sd_event_add_time(ev.get(), nullptr, CLOCK_MONOTONIC,
+                             now_usec + 1000000, 0,
+                             receiver::progress_callback, &rx)) < 0)
+    throw std::system_error{-r, std::system_category()};
+
+  if (type == backend_type::io_uring) {
+    rx.uring = std::make_unique<uring_backend::backend>(rx.uni, ev.get());
+    if (strip)
+      rx.uring->set_output(
+          strip->device(),
+          [strip]() -> const std::vector<iovec>& { return strip->prepare(); });
+    else
+      rx.uring->set_output(
+          rx.null_fd,
+          [&rx]() -> const std::vector<iovec>& { return rx.frame_iov; });
+  } else if ((r = sd_event_add_io(ev.get(), nullptr, rx.uni.event_fd(),
+                                  EPOLLIN, receiver::universe_callback,
+                                  &rx)) < 0) {
+    throw std::system_error{-r, std::system_category()};
+  }
+
+  /* One more packet than counted, as the first one adds the source */
+  pid_t sender{fork()};
+  if (sender == -1) throw std::system_error{errno, std::system_category()};
+  if (sender == 0) run_sender(packets + 1, rate);
+
+  try {
+    while ((rx.frames <= packets) &&
+           (sd_event_get_state(ev.get()) != SD_EVENT_FINISHED)) {
+      if (rx.uring) {
+        if (rx.uring->run()) rx.process(rx.uni.flush());
+      } else if ((r = sd_event_run(ev.get(), UINT64_MAX)) < 0) {
+        throw std::system_error{-r, std::system_category()};
+      }
+    }
+  } catch (...) {
+    kill(sender, SIGTERM);
+    waitpid(sender, nullptr, 0);
+    throw;
+  }
+  auto calls{rx.counter.read() - rx.start};
+  kill(sender, SIGTERM);
+  waitpid(sender, nullptr, 0);
+
+  long counted{rx.frames - 1};
+  if (counted < 1) throw std::runtime_error{"no frames received"};
+  std::printf("syscalls (%s): %.2f per frame over %ld frame(s), %ld "
+              "packet(s) lost, writing to %s\n",
+              name, static_cast<double>(calls) / counted, counted,
+              packets - counted, strip ? "the LEDs" : "/dev/null");
+}
+
+/**
+ * Count the system calls made per frame received and written, through each
+ * receive path given.
+ *
+ * The receiver binds the E1.31 port with SO_REUSEPORT, so stop any daemon
+ * on the same host that does not, or that would take the packets.
+ *
+ * Options:
+ *   --packets=N     frames counted per receive path [default: 10000]
+ *   --rate=N        packets sent per second [default: 1000]
+ *   --backends=LIST comma-separated receive paths to compare, of
+ *                   'sd-event' and 'io_uring' [default: sd-event,io_uring]
+ *   --spidev=FILE   SPI device to write each frame to, as the daemon does
+ *                   [default: write to /dev/null]
+ */
+int
+syscalls(const bench::options& opts)
+{
+  opts.expect({"packets", "rate", "backends", "spidev"});
+  long packets(opts.number("packets", 10000));
+  long rate(opts.number("rate", 1000));
+  auto spidev{opts.text("spidev", "")};
+  if ((packets < 1) || (rate < 1) || (rate > 1000000))
+    throw std::invalid_argument{"invalid packet count or rate"};
+
+  std::vector<std::pair<std::string, backend_type>> backends;
+  std::istringstream list{opts.text("backends", "sd-event,io_uring")};
+  for (std::string backend; std::getline(list, backend, ',');) {
+    if (backend == "sd-event")
+      backends.emplace_back(backend, backend_type::sd_event);
+    else if (backend == "io_uring")
+      backends.emplace_back(backend, backend_type::io_uring);
+    else
+      throw std::invalid_argument{"unknown receive path " + backend};
+  }
+
+  std::unique_ptr<strip_type> strip;
+  if (!spidev.empty()) strip = std::make_unique<strip_type>(spidev);
+
+  for (const auto& backend : backends)
+    measure(backend.first.c_str(), backend.second, opts, strip.get());
+  return EXIT_SUCCESS;
+}
+
+bench::registration reg{"syscalls",
+                        "system calls per frame of the sd-event and io_uring "
+                        "receive paths",
+                        syscalls};
+} // namespace
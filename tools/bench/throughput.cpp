@@ -0,0 +1,131 @@
+/**
+ * \file throughput.cpp
+ *
+ * Packets per second processed by the E1.31 receiver, without a socket, so
+ * that regressions in validation, sequencing, arbitration and merging show
+ * up apart from the network stack.
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <bench.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <e131_receiver.hpp>
+#include <fstream>
+#include <heap_counter.hpp>
+#include <packet_builder.hpp>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+/**
+ * Measure the rate at which packets from a number of sources are
+ * processed, in packets per second.
+ *
+ * Options:
+ *   --sources=N    sources sending to the universe [default: 4]
+ *   --packets=N    packets processed per run [default: 1000000]
+ *   --batch=N      packets processed between updates [default: 16]
+ *   --merge=MODE   'ltp' or 'htp' [default: ltp]
+ *   --runs=N       runs, of which the fastest is reported [default: 5]
+ *   --min-rate=N   fail below this rate
+ *   --baseline=F   fail if slower than the rate in F by more than the
+ *                  tolerance, or record the rate in F if it does not exist
+ *   --tolerance=P  tolerated slowdown, in percent [default: 10]
+ */
+int
+throughput(const bench::options& opts)
+{
+  opts.expect({"sources", "packets", "batch", "merge", "runs", "min-rate",
+               "baseline", "tolerance"});
+  int sources(opts.number("sources", 4));
+  long packets(opts.number("packets", 1000000));
+  long batch(opts.number("batch", 16));
+  int runs(opts.number("runs", 5));
+  double tolerance{opts.number("tolerance", 10)};
+  auto merge_name{opts.text("merge", "ltp")};
+  if ((sources < 1) || (packets < 1) || (batch < 1) || (runs < 1))
+    throw std::invalid_argument{"counts must be positive"};
+  if ((merge_name != "ltp") && (merge_name != "htp"))
+    throw std::invalid_argument{"--merge must be 'ltp' or 'htp'"};
+
+  constexpr int universe_num{1};
+  e131_receiver::universe uni{e131_receiver::no_socket, sources, false,
+                              universe_num,
+                              (merge_name == "htp")
+                                  ? e131_receiver::merge_mode::htp
+                                  : e131_receiver::merge_mode::ltp};
+
+  std::vector<packet_builder::packet> pkts(sources,
+                                           packet_builder::packet_template);
+  for (int i{0}; i < sources; i++)
+    packet_builder::set_header(pkts[i], packet_builder::source_cid(i),
+                               universe_num, 100, 0);
+
+  double best{0};
+  unsigned long allocations{0};
+  std::uint8_t sequence{0};
+  for (int run{0}; run <= runs; run++) {
+    /* The first run registers the sources and warms up caches */
+    auto before{heap_counter::allocations()};
+    auto start{bench::now()};
+    std::uint64_t arrival{start / 1000};
+
+    for (long i{0}; i < packets; i++) {
+      auto& pkt{pkts[i % sources]};
+      if ((i % sources) == 0) sequence++;
+      pkt[packet_builder::sequence_offset] = sequence;
+      pkt[packet_builder::data_offset]     = static_cast<std::uint8_t>(i);
+      uni.process_packet(pkt.data(), pkt.size(), arrival);
+      if (((i + 1) % batch) == 0) {
+        uni.update();
+        arrival = bench::now() / 1000;
+      }
+    }
+    uni.update();
+
+    double rate{packets * 1e9 / (bench::now() - start)};
+    if (run == 0) continue;
+    best = std::max(best, rate);
+    allocations += heap_counter::allocations() - before;
+  }
+
+  std::printf("throughput: %.0f packets/s, %d source(s), %s, batch of %ld, "
+              "%lu heap allocation(s)\n",
+              best, sources, merge_name.c_str(), batch, allocations);
+
+  double minimum{opts.number("min-rate", 0)};
+  if (best < minimum) {
+    std::printf("throughput: below the minimum of %.0f packets/s\n", minimum);
+    return EXIT_FAILURE;
+  }
+
+  auto baseline_path{opts.text("baseline", "")};
+  if (baseline_path.empty()) return EXIT_SUCCESS;
+
+  double baseline{0};
+  if (!(std::ifstream{baseline_path} >> baseline)) {
+    if (!(std::ofstream{baseline_path} << best << '\n'))
+      throw std::runtime_error{"unable to write " + baseline_path};
+    std::printf("throughput: recorded baseline in %s\n", baseline_path.c_str());
+    return EXIT_SUCCESS;
+  }
+
+  double change{((best / baseline) - 1) * 100};
+  std::printf("throughput: %+.1f%% against the baseline of %.0f packets/s\n",
+              change, baseline);
+  if (change < -tolerance) {
+    std::printf("throughput: regressed by more than %.1f%%\n", tolerance);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+bench::registration reg{"throughput",
+                        "packets/s through the receiver, without a socket",
+                        throughput};
+} // namespace
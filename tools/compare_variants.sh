@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# Builds the release, processor-tuned, profile-guided and static variants,
+# and reports the packet throughput of each as a speedup over the release
+# variant, to choose which one to ship. Run from the source tree.
+#
+# The profile-guided variant is trained with the throughput benchmark, which
+# covers the receiver code in the library shared with the daemon.
+#
+# Usage: tools/compare_variants.sh [TARGET_CPU...] [-- BENCH_OPTION...]
+#   e.g. tools/compare_variants.sh cortex-a53 -- --sources=8 --merge=htp
+
+set -e
+
+cpus=""
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+  cpus="$cpus $1"
+  shift
+done
+[ "$1" = "--" ] && shift
+
+results=$(mktemp -d)
+trap 'rm -rf "$results"' EXIT
+
+# Each variant is benchmarked from a copy, as tuned builds replace Release
+scons -Q release bench
+cp Release/e131_bench "$results/release"
+for cpu in $cpus; do
+  scons -Q release bench TARGET_CPU="$cpu"
+  cp Release/e131_bench "$results/release-$cpu"
+done
+
+scons -Q pgo PGO=generate
+PGO/e131_bench throughput --runs=1 "$@" > /dev/null
+scons -Q pgo PGO=use
+cp PGO/e131_bench "$results/pgo"
+
+scons -Q static
+cp Static/e131_bench "$results/static"
+
+# Leave the plain release variant built
+[ -n "$cpus" ] && scons -Q release bench
+
+base=""
+for variant in release $(for cpu in $cpus; do echo "release-$cpu"; done) \
+               pgo static; do
+  r=$("$results/$variant" throughput "$@" |
+      sed -n 's/^throughput: \([0-9]*\) packets\/s.*/\1/p')
+  [ -z "$base" ] && base=$r
+  awk -v v="$variant" -v r="$r" -v b="$base" \
+      'BEGIN { printf "%-24s %12d packets/s %6.2fx\n", v, r, r / b }'
+done
@@ -0,0 +1,150 @@
+/**
+ * \file fuzz_process_packet.cpp
+ *
+ * libFuzzer target feeding packets to the E1.31 processing core, through
+ * \ref e131_receiver::universe::process_packet().
+ *
+ * The first byte of an input selects the receiver configuration, and the
+ * rest is a sequence of records, each a little-endian 16-bit header and the
+ * number of bytes it gives in its low 15 bits. The high bit of the header
+ * calls \ref e131_receiver::universe::update() after the record.
+ *
+ * Raw records are passed as they are, to exercise validation. Structured
+ * records select a source, priority, sequence number and options, and
+ * overlay the rest onto the DMX data of a valid packet, to exercise
+ * sequencing, arbitration and merging.
+ *
+ * Build with 'scons fuzz', which requires clang, or with 'scons fuzz
+ * FUZZ=replay' to build a program that replays inputs given as files under
+ * GCC's sanitizers.
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <e131_receiver.hpp>
+#include <packet_builder.hpp>
+
+#ifdef FUZZ_REPLAY
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+#endif
+
+namespace
+{
+/* Receiver configuration flags, in the first byte of an input */
+constexpr std::uint8_t flag_htp{0x01};
+constexpr std::uint8_t flag_ignore_preview{0x02};
+constexpr std::uint8_t flag_discovery{0x04};
+constexpr std::uint8_t flag_structured{0x08};
+constexpr std::uint8_t flag_sources_shift{4};
+
+constexpr int universe_num{1};
+constexpr std::uint16_t record_update{0x8000};
+constexpr std::size_t structured_header_size{4};
+constexpr unsigned int structured_sources{8};
+
+/**
+ * Check the state of the receiver after an update, stopping the fuzzer on
+ * inconsistencies.
+ */
+void
+check(const e131_receiver::universe& uni,
+      const std::vector<e131_receiver::update_event>& events, int max_sources,
+      int& tracked)
+{
+  for (const auto& e : events) {
+    if (e.event == e131_receiver::update_event::SOURCE_ADDED)
+      tracked++;
+    else if (e.event == e131_receiver::update_event::SOURCE_REMOVED)
+      tracked--;
+  }
+
+  int visited{0};
+  uni.for_each_source([&visited](const auto&, const auto&) { visited++; });
+
+  const auto& prio{uni.prio_tracker()};
+  if ((tracked != visited) || (prio.total_sources() != visited) ||
+      (visited > max_sources) || (prio.sources() > visited) ||
+      ((visited > 0) && (prio.sources() == 0)))
+    __builtin_trap();
+}
+} // namespace
+
+extern "C" int
+LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+  if (size < 1) return 0;
+
+  std::uint8_t flags{data[0]};
+  int max_sources(1 + (flags >> flag_sources_shift));
+  e131_receiver::universe uni{e131_receiver::no_socket, max_sources,
+                              (flags & flag_ignore_preview) != 0, universe_num,
+                              (flags & flag_htp)
+                                  ? e131_receiver::merge_mode::htp
+                                  : e131_receiver::merge_mode::ltp};
+  if (flags & flag_discovery) uni.enable_discovery();
+
+  packet_builder::packet pkt{};
+  std::uint64_t arrival{1};
+  int tracked{0};
+  data++;
+  size--;
+
+  while (size >= 2) {
+    std::uint16_t header(data[0] | (data[1] << 8));
+    std::size_t len{std::min<std::size_t>(header & ~record_update, size - 2)};
+    const std::uint8_t* record{data + 2};
+    data += 2 + len;
+    size -= 2 + len;
+
+    if (!(flags & flag_structured)) {
+      uni.process_packet(record, len, arrival);
+    } else if (len >= structured_header_size) {
+      pkt = packet_builder::packet_template;
+      packet_builder::set_header(
+          pkt, packet_builder::source_cid(record[0] % structured_sources),
+          universe_num, record[1], record[2], record[3]);
+      len = std::min(len - structured_header_size,
+                     pkt.size() - packet_builder::data_offset);
+      std::copy_n(record + structured_header_size, len,
+                  pkt.begin() + packet_builder::data_offset);
+      uni.process_packet(pkt.data(), pkt.size(), arrival);
+    }
+    arrival += 1000;
+
+    if (header & record_update)
+      check(uni, uni.update(), max_sources, tracked);
+  }
+
+  check(uni, uni.update(), max_sources, tracked);
+  return 0;
+}
+
+#ifdef FUZZ_REPLAY
+/**
+ * Replay inputs given as files, for builds without libFuzzer.
+ */
+int
+main(int argc, char** argv)
+{
+  for (int i{1}; i < argc; i++) {
+    std::ifstream in{argv[i], std::ios::binary};
+    if (!in) {
+      std::cerr << "Unable to open " << argv[i] << '\n';
+      return 1;
+    }
+
+    std::vector<std::uint8_t> input{std::istreambuf_iterator<char>{in},
+                                    std::istreambuf_iterator<char>{}};
+    LLVMFuzzerTestOneInput(input.data(), input.size());
+  }
+  return 0;
+}
+#endif
@@ -0,0 +1,104 @@
+/**
+ * \file packet_builder.hpp
+ *
+ * Construction of E1.31 data packets, for the fuzz target and benchmarks.
+ *
+ * \copyright Shenghao Yang, 2018
+ *
+ * See LICENSE for details
+ */
+
+#ifndef PACKET_BUILDER_HPP_
+#define PACKET_BUILDER_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <e131_receiver.hpp>
+
+namespace packet_builder
+{
+/* Packet layout, ANSI E1.31-2016 section 4 */
+constexpr std::size_t cid_offset{22};
+constexpr std::size_t priority_offset{108};
+constexpr std::size_t sequence_offset{111};
+constexpr std::size_t options_offset{112};
+constexpr std::size_t universe_offset{113};
+constexpr std::size_t data_offset{126};
+constexpr std::size_t packet_size{data_offset + 512};
+constexpr std::uint8_t option_preview{0x80};
+constexpr std::uint8_t option_terminated{0x40};
+
+/**
+ * E1.31 data packet carrying a full universe.
+ */
+using packet = std::array<std::uint8_t, packet_size>;
+
+/**
+ * Packet carrying a full universe of zeroes, with the CID, priority,
+ * sequence number, options and universe number left blank.
+ */
+constexpr packet packet_template{[]() {
+  packet h{};
+  constexpr std::array<std::uint8_t, 16> preamble{
+      0x00, 0x10, 0x00, 0x00, 'A', 'S', 'C', '-',
+      'E',  '1',  '.',  '1',  '7', 0x00, 0x00, 0x00};
+  auto put16{[&h](std::size_t offset, std::uint16_t v) {
+    h[offset]     = static_cast<std::uint8_t>(v >> 8);
+    h[offset + 1] = static_cast<std::uint8_t>(v);
+  }};
+
+  for (std::size_t i{0}; i < preamble.size(); i++) h[i] = preamble[i];
+  /* Flags and length of each layer, then its vector */
+  put16(16, 0x7000 | (packet_size - 16));
+  h[21] = 0x04;
+  put16(38, 0x7000 | (packet_size - 38));
+  h[43] = 0x02;
+  put16(115, 0x7000 | (packet_size - 115));
+  h[117] = 0x02;
+  /* Address and data type, address increment, property value count */
+  h[118] = 0xa1;
+  put16(121, 0x0001);
+  put16(123, 513);
+  return h;
+}()};
+
+/**
+ * Fill in the header fields of a packet built from \ref packet_template.
+ *
+ * \param pkt packet to fill in.
+ * \param uuid CID of the sending source.
+ * \param universe_num universe number the packet is sent to.
+ * \param prio priority of the source.
+ * \param sequence sequence number of the packet.
+ * \param options options flags of the packet.
+ */
+inline void
+set_header(packet& pkt, const e131_receiver::cid& uuid, int universe_num,
+           std::uint8_t prio, std::uint8_t sequence, std::uint8_t options = 0)
+{
+  for (std::size_t i{0}; i < uuid.size(); i++) pkt[cid_offset + i] = uuid[i];
+  pkt[priority_offset]     = prio;
+  pkt[sequence_offset]     = sequence;
+  pkt[options_offset]      = options;
+  pkt[universe_offset]     = static_cast<std::uint8_t>(universe_num >> 8);
+  pkt[universe_offset + 1] = static_cast<std::uint8_t>(universe_num);
+}
+
+/**
+ * Obtain a distinct CID for each source index.
+ *
+ * \param index source index.
+ * \return CID of the source.
+ */
+inline e131_receiver::cid
+source_cid(unsigned int index)
+{
+  e131_receiver::cid uuid{};
+  for (std::size_t i{0}; i < uuid.size(); i++)
+    uuid[i] = static_cast<std::uint8_t>((index >> ((i % 4) * 8)) + i);
+  return uuid;
+}
+} // namespace packet_builder
+
+#endif /* PACKET_BUILDER_HPP_ */
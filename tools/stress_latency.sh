@@ -0,0 +1,35 @@
+#!/bin/sh
+#
+# Reports the worst-case latency from sending an E1.31 packet to committing
+# it to the LEDs, idle and under a stress-ng background load, to check the
+# low-latency mode enabled with realtime.enabled.
+#
+# Run as root on the board, from the source tree, with the daemon stopped:
+#   tools/stress_latency.sh [BENCH] [-- BENCH_OPTION...]
+#   e.g. tools/stress_latency.sh -- --spidev=/dev/spidev0.0 --realtime=50
+#
+# BENCH defaults to Release/e131_bench. STRESS overrides the load, which
+# defaults to every CPU, the VM and the page cache being kept busy.
+
+set -e
+
+bench=Release/e131_bench
+if [ $# -gt 0 ] && [ "$1" != "--" ]; then
+  bench=$1
+  shift
+fi
+[ "$1" = "--" ] && shift
+
+: "${STRESS:=--cpu 0 --vm 2 --vm-bytes 25% --io 2 --timeout 600s}"
+
+echo "Idle:"
+"$bench" latency "$@"
+
+# shellcheck disable=SC2086
+stress-ng $STRESS --quiet &
+stress=$!
+trap 'kill $stress 2> /dev/null' EXIT
+sleep 2
+
+echo "Under stress-ng $STRESS:"
+"$bench" latency "$@"